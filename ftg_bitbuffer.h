@@ -40,6 +40,18 @@
 
     - Define BITBUF_ASSERT prior to include to override default assert() handler
 
+    - Define BITBUF_BENCHMARKS_ENABLED in the implementation file to
+      compile bitbuf_run_benchmarks(), which prints timings to stdout
+
+    - Define BITBUF_MALLOC and BITBUF_FREE prior to include to override
+      the default allocator.  Additionally define BITBUF_REALLOC to use
+      it when growable buffers expand.
+
+    - Define BITBUF_POOL_CACHE_MAX prior to include to change how many
+      free buffers of each size class a thread keeps for
+      bitbuf_alloc_pooled_buffer() before handing half of them to the
+      shared list.  Defaults to 32.
+
    REVISION HISTORY
 
    1.0  2023-01-17   Initial version
@@ -77,7 +89,8 @@
 //
 //  - This code does not take any action to manage endianness.
 //
-//  - The buffer size must be known at start; bitbuffers are not stretchy
+//  - The buffer size must be known at start unless the buffer is
+//    allocated with bitbuf_alloc_growable_buffer()
 //
 //  - The floating point quantization function is not guaranteed to
 //    output out_min == in_min, or out_max == in_max, except for the
@@ -145,6 +158,7 @@
 #ifndef BITBUF_MALLOC
 #    define BITBUF_MALLOC(size) malloc(size)
 #    define BITBUF_FREE(ptr) free(ptr)
+#    define BITBUF_REALLOC(ptr, size) realloc(ptr, size)
 #endif
 
 // include ftg_core.h ahead of this header to debug it
@@ -169,6 +183,8 @@
 #    endif
 #elif defined(_MSC_VER) && (_MSC_VER >= 1700)
 #    define BITBUF_INLINE __inline
+#else
+#    define BITBUF_INLINE
 #endif
 
 #ifdef __cplusplus
@@ -180,6 +196,9 @@ extern "C" {
 
 typedef struct bitbuf_buffer_s bitbuf_buffer_t;
 
+// ftg_core.h arena, only used if ftg_core.h is included first
+struct ftg_arena_s;
+
 typedef struct {
     // seg == data when at beginning
     uint64_t* seg;
@@ -200,14 +219,97 @@ struct bitbuf_buffer_s {
     size_t    capacity_bytes;
     int       truncated;
 
+    // set to 1 if writes past capacity double the storage instead of
+    // truncating
+    int growable;
+
+    // if non-NULL, growable storage comes from this arena and is
+    // released when the arena is freed
+    struct ftg_arena_s** arena;
+
+    // number of open checkpoints.  truncation is expected while one
+    // is open, so it does not assert.
+    int open_checkpoints;
+
+    // set to 1 for buffers from bitbuf_init_measure_buffer, which only
+    // count the bits written in measured_bits
+    int    measuring;
+    size_t measured_bits;
+
+    // set to 1 for buffers from bitbuf_alloc_pooled_buffer, which
+    // bitbuf_free_buffer returns to the pool
+    int pooled;
+
     bitbuf_cursor_t write;
 };
 
+// saved write position, see bitbuf_checkpoint
+typedef struct {
+    // stored as a bit offset, as growable storage may move
+    size_t bit_pos;
+    int    truncated;
+} bitbuf_checkpoint_t;
+
 
 
 // allocate a new buffer for writing
 BITBUFDEF bitbuf_buffer_t bitbuf_alloc_buffer(size_t max_bytes);
 
+// allocate a new buffer for writing that doubles in size instead of
+// truncating when a write exceeds its capacity.
+//
+// pointers returned by bitbuf_get_bytes_from_buffer are invalidated
+// by subsequent writes to a growable buffer.
+BITBUFDEF bitbuf_buffer_t bitbuf_alloc_growable_buffer(size_t initial_bytes);
+
+#ifdef FTG__INCLUDE_CORE_H
+// allocate a growable buffer whose storage comes from *arena.
+//
+// storage abandoned by growth is reclaimed when the arena is freed.
+// bitbuf_free_buffer() is optional for these buffers and does not
+// release memory.
+BITBUFDEF bitbuf_buffer_t bitbuf_alloc_growable_buffer_in_arena(struct ftg_arena_s** arena,
+                                                                size_t initial_bytes);
+#endif
+
+// init a buffer that stores nothing, for sizing messages.  writes only
+// advance a bit count, without touching memory or checking capacity.
+// run serialization code on it first to learn the exact size of a
+// message, then again on a real buffer.
+//
+// a measuring buffer cannot be read.  bitbuf_get_bytes_from_buffer
+// returns NULL with the byte count the writes would take.  there is no
+// need to free it.
+BITBUFDEF bitbuf_buffer_t bitbuf_init_measure_buffer(void);
+
+// number of bits written to a buffer so far
+BITBUFDEF size_t bitbuf_num_bits_written(const bitbuf_buffer_t* buf);
+
+// allocate a zeroed buffer of at least max_bytes from a pool of
+// power-of-two size classes, 64 bytes to 64KiB.  larger requests fall
+// back to bitbuf_alloc_buffer.
+//
+// bitbuf_free_buffer returns the storage to a cache local to the
+// calling thread, zeroing only the bytes that were written, so a
+// recycled buffer costs neither an allocation nor a full clear.  when
+// a thread caches more than BITBUF_POOL_CACHE_MAX buffers of a class,
+// half of them move to a lock-free list shared by all threads, which
+// threads with empty caches drain.  buffers may be freed on a
+// different thread than the one that allocated them.
+//
+// the capacity of a pooled buffer is its size class, which may exceed
+// max_bytes.
+BITBUFDEF bitbuf_buffer_t bitbuf_alloc_pooled_buffer(size_t max_bytes);
+
+// move the calling thread's cached pool buffers to the shared list.
+// call before a thread that freed pooled buffers exits, or its cached
+// storage leaks.
+BITBUFDEF void bitbuf_pool_flush_thread_cache(void);
+
+// release the calling thread's cached pool buffers and the shared
+// list back to BITBUF_FREE.  buffers cached by other threads are kept.
+BITBUFDEF void bitbuf_pool_trim(void);
+
 // allocate a new buffer, copying *bytes into it
 BITBUFDEF bitbuf_buffer_t bitbuf_alloc_buffer_with_bytes(const uint8_t* bytes,
                                                          size_t num_bytes);
@@ -223,6 +325,39 @@ BITBUFDEF void bitbuf_free_buffer(bitbuf_buffer_t*);
 BITBUFDEF const uint8_t* bitbuf_get_bytes_from_buffer(const bitbuf_buffer_t*,
                                                       size_t* out_num_bytes);
 
+#if defined(__unix__) || defined(__APPLE__)
+#    define BITBUF_HAS_IOVEC
+struct iovec;
+
+// gather the bytes of num_bufs buffers, as returned by
+// bitbuf_get_bytes_from_buffer, into out_iov[0..num_bufs) for writev or
+// sendmsg without copying.  returns the total number of bytes.
+//
+// each buffer contributes whole bytes, so one that ends mid-byte is
+// followed by up to 7 zero padding bits.  use bitbuf_concat_buffers
+// when the receiver expects a single unpadded bit stream.
+BITBUFDEF size_t bitbuf_export_iovec(const bitbuf_buffer_t* const* bufs,
+                                     size_t                        num_bufs,
+                                     struct iovec*                 out_iov);
+#endif
+
+// append every bit written to num_srcs buffers, in order, to dst,
+// without padding between them.  if the bits do not fit, dst is left
+// unchanged.
+BITBUFDEF void bitbuf_concat_buffers(bitbuf_buffer_t*              dst,
+                                     const bitbuf_buffer_t* const* srcs,
+                                     size_t                        num_srcs);
+
+// append every bit written to src to dst.  a word at a time, whatever
+// the bit offsets of the two.  if the bits do not fit, dst is left
+// unchanged.
+BITBUFDEF void bitbuf_append_buffer(bitbuf_buffer_t* dst, const bitbuf_buffer_t* src);
+
+// append num_bits read from a cursor to dst, a word at a time.  the
+// cursor advances past them even if they do not fit in dst.  if fewer
+// bits remain, nothing is copied and read_past_end is set.
+BITBUFDEF void bitbuf_append_bits(bitbuf_buffer_t* dst, bitbuf_cursor_t* read, size_t num_bits);
+
 
 
 // init a cursor, used for reading from a bitbuffer.
@@ -237,6 +372,31 @@ bitbuf_cursor_t bitbuf_cursor_init(bitbuf_buffer_t* buffer);
 // checks if ANY bitbuf write so far has truncated this bitbuffer.
 BITBUFDEF bool bitbuf_has_truncated(const bitbuf_buffer_t*);
 
+// speculative writes.  bitbuf_checkpoint saves the write position,
+// and every checkpoint must be closed by either bitbuf_rollback, which
+// discards the writes since, or bitbuf_commit, which keeps them.
+//
+// truncation while a checkpoint is open does not assert, so a packet
+// can be filled greedily in one pass:
+//
+//  bitbuf_checkpoint_t cp = bitbuf_checkpoint(&buf);
+//  write_entity(&buf, entity);
+//  if (bitbuf_has_truncated(&buf))
+//      bitbuf_rollback(&buf, &cp);
+//  else
+//      bitbuf_commit(&buf, &cp);
+//
+// checkpoints may nest.  do not checkpoint while a bitbuf_writer_t is
+// active on the buffer.
+BITBUFDEF bitbuf_checkpoint_t bitbuf_checkpoint(bitbuf_buffer_t* buf);
+
+// rewind the write cursor to checkpoint, zeroing the bits written since
+// and restoring the truncated flag
+BITBUFDEF void bitbuf_rollback(bitbuf_buffer_t* buf, const bitbuf_checkpoint_t* checkpoint);
+
+// close checkpoint, keeping the bits written since
+BITBUFDEF void bitbuf_commit(bitbuf_buffer_t* buf, const bitbuf_checkpoint_t* checkpoint);
+
 // bitbuf write routines
 BITBUFDEF void bitbuf_write_int64(bitbuf_buffer_t*, int64_t value);
 BITBUFDEF void bitbuf_write_int32(bitbuf_buffer_t*, int32_t value);
@@ -253,9 +413,18 @@ BITBUFDEF void bitbuf_write_bool(bitbuf_buffer_t*, bool);
 // write up to strlen(str) + 1 bytes to the bitbuffer, including the null terminator
 BITBUFDEF void bitbuf_write_cstr(bitbuf_buffer_t* buf, const char* str);
 
+// write num_bytes raw bytes.  the write is a memcpy if the write cursor
+// is byte aligned.  if the bytes do not fit, none are written.
+BITBUFDEF void bitbuf_write_bytes(bitbuf_buffer_t* buf, const void* bytes, size_t num_bytes);
+
 // write n bits (up to 64)
 BITBUFDEF void bitbuf_write_n_bits(bitbuf_buffer_t* buf, int num_bits, uint64_t value);
 
+// write an integer known to be in [min, max], using the fewest bits that
+// can represent the range.  see BITBUF_BITS_FOR_RANGE for the width.
+BITBUFDEF void
+bitbuf_write_ranged_int(bitbuf_buffer_t* buf, int64_t min, int64_t max, int64_t value);
+
 // write a quantized float, using num_bits precision that must be
 // between max and min (inclusive)
 BITBUFDEF void bitbuf_write_quantized_float(
@@ -290,27 +459,687 @@ BITBUFDEF uint64_t bitbuf_read_n_bits(bitbuf_cursor_t* read,
                                       int              num_bits,
                                       uint64_t*        out_mask);
 
+// read n bits (up to 64) without advancing the cursor.  bits past the
+// end of the buffer read as zero.
+BITBUFDEF uint64_t bitbuf_peek_n_bits(const bitbuf_cursor_t* read, int num_bits);
+
+// random access reads.  tell returns the bit offset of a cursor from
+// the start of the buffer, and seek moves it to any offset up to the
+// end of the buffer, forwards or backwards.
+//
+// seeking past the end sets read_past_end and leaves the cursor where
+// it was.
+BITBUFDEF size_t bitbuf_cursor_tell_bits(const bitbuf_cursor_t* read);
+BITBUFDEF void   bitbuf_cursor_seek_bits(bitbuf_cursor_t* read, size_t bit_pos);
+
 // read up to max_bytes from the bitbuffer including null terminator,
 // putting the result in out_str.  if max_bytes is reached,
 // strlen(out_str) == 0 and the read cursor points at the last
 // position read (not reset).
 BITBUFDEF void bitbuf_read_cstr(bitbuf_cursor_t* read, size_t max_bytes, char* out_str);
 
+// read num_bytes raw bytes into out_bytes.  if fewer bytes remain,
+// nothing is read, out_bytes is zeroed and read_past_end is set.
+BITBUFDEF void bitbuf_read_bytes(bitbuf_cursor_t* read, void* out_bytes, size_t num_bytes);
+
+// zero-copy reads: return a pointer into the buffer's memory and
+// advance the cursor past the bytes, instead of copying them out.
+//
+// the cursor must be byte aligned; call bitbuf_skip_byte_padding
+// first, after the writer called bitbuf_pad_to_byte.  NULL is returned
+// if the cursor is unaligned, too few bytes remain, or on big endian
+// targets, where stream bytes are not in memory order.
+//
+// returned pointers are valid for the lifetime of the buffer's memory.
+BITBUFDEF const uint8_t* bitbuf_read_bytes_view(bitbuf_cursor_t* read, size_t num_bytes);
+
+// as bitbuf_read_bytes_view, for a null terminated string.  if
+// non-null, *out_len is set to strlen of the returned string.
+BITBUFDEF const char* bitbuf_read_cstr_view(bitbuf_cursor_t* read, size_t* out_len);
+
 
 // skip byte padding generated by bitbuf_pad_to_byte
 BITBUFDEF void bitbuf_skip_byte_padding(bitbuf_cursor_t* read);
 
+// variable length integers.  value is written in groups of group_bits
+// payload bits, least significant first, each followed by a
+// continuation bit.  small values take fewer bits.
+//
+// group_bits is 1..63; 4 and 7 are typical.  the reader must use the
+// same group_bits as the writer.  signed values are zigzag encoded so
+// small magnitudes of either sign are small.
+BITBUFDEF void bitbuf_write_varint_u64(bitbuf_buffer_t* buf, int group_bits, uint64_t value);
+BITBUFDEF void bitbuf_write_varint_i64(bitbuf_buffer_t* buf, int group_bits, int64_t value);
+BITBUFDEF uint64_t bitbuf_read_varint_u64(bitbuf_cursor_t* read, int group_bits);
+BITBUFDEF int64_t  bitbuf_read_varint_i64(bitbuf_cursor_t* read, int group_bits);
+
+// universal codes for small non-negative integers, where values near
+// zero are far more common than large ones.  each begins with a run of
+// zero bits ended by a one bit, which decoding finds with one count
+// trailing zeros rather than bit by bit.
+//
+// rice codes value >> k as a zero run, then the low k bits of value,
+// for value >> k + k + 1 bits.  k is 0..63; it suits values of a known
+// scale, with k near log2 of the mean.
+//
+// elias gamma and delta take no parameter.  they code value + 1, so
+// value must be less than UINT64_MAX.  with w the bit width of
+// value + 1 less one, gamma costs 2 * w + 1 bits, and delta costs
+// w + 2 * floor(log2(w + 1)) + 1, less than gamma once w reaches 5.
+//
+// a code that does not fit, or a rice code with a zero run over 2^24
+// bits, is not written and truncates the buffer.
+//
+// if a code is malformed or runs off the end of the buffer,
+// read_past_end is set and 0 returned.
+BITBUFDEF void     bitbuf_write_rice(bitbuf_buffer_t* buf, int k, uint64_t value);
+BITBUFDEF void     bitbuf_write_elias_gamma(bitbuf_buffer_t* buf, uint64_t value);
+BITBUFDEF void     bitbuf_write_elias_delta(bitbuf_buffer_t* buf, uint64_t value);
+BITBUFDEF uint64_t bitbuf_read_rice(bitbuf_cursor_t* read, int k);
+BITBUFDEF uint64_t bitbuf_read_elias_gamma(bitbuf_cursor_t* read);
+BITBUFDEF uint64_t bitbuf_read_elias_delta(bitbuf_cursor_t* read);
+
+// bulk array routines.  capacity is checked once for the whole array,
+// and values are packed without per-value overhead.
+//
+// the n_bits variants write the low num_bits of each value; higher
+// bits are ignored.  the others write full width values.
+//
+// if the array does not fit, nothing is written (or read), and the
+// buffer is truncated (or read_past_end is set and out_values zeroed).
+BITBUFDEF void bitbuf_write_n_bits_array_uint64(bitbuf_buffer_t* buf,
+                                                int              num_bits,
+                                                const uint64_t*  values,
+                                                size_t           count);
+BITBUFDEF void bitbuf_write_n_bits_array_uint32(bitbuf_buffer_t* buf,
+                                                int              num_bits,
+                                                const uint32_t*  values,
+                                                size_t           count);
+BITBUFDEF void bitbuf_write_n_bits_array_uint16(bitbuf_buffer_t* buf,
+                                                int              num_bits,
+                                                const uint16_t*  values,
+                                                size_t           count);
+BITBUFDEF void bitbuf_write_n_bits_array_uint8(bitbuf_buffer_t* buf,
+                                               int              num_bits,
+                                               const uint8_t*   values,
+                                               size_t           count);
+BITBUFDEF void bitbuf_write_uint64_array(bitbuf_buffer_t* buf, const uint64_t* values, size_t count);
+BITBUFDEF void bitbuf_write_uint32_array(bitbuf_buffer_t* buf, const uint32_t* values, size_t count);
+BITBUFDEF void bitbuf_write_uint16_array(bitbuf_buffer_t* buf, const uint16_t* values, size_t count);
+BITBUFDEF void bitbuf_write_uint8_array(bitbuf_buffer_t* buf, const uint8_t* values, size_t count);
+
+BITBUFDEF void bitbuf_read_n_bits_array_uint64(bitbuf_cursor_t* read,
+                                               int              num_bits,
+                                               uint64_t*        out_values,
+                                               size_t           count);
+BITBUFDEF void bitbuf_read_n_bits_array_uint32(bitbuf_cursor_t* read,
+                                               int              num_bits,
+                                               uint32_t*        out_values,
+                                               size_t           count);
+BITBUFDEF void bitbuf_read_n_bits_array_uint16(bitbuf_cursor_t* read,
+                                               int              num_bits,
+                                               uint16_t*        out_values,
+                                               size_t           count);
+BITBUFDEF void bitbuf_read_n_bits_array_uint8(bitbuf_cursor_t* read,
+                                              int              num_bits,
+                                              uint8_t*         out_values,
+                                              size_t           count);
+BITBUFDEF void bitbuf_read_uint64_array(bitbuf_cursor_t* read, uint64_t* out_values, size_t count);
+BITBUFDEF void bitbuf_read_uint32_array(bitbuf_cursor_t* read, uint32_t* out_values, size_t count);
+BITBUFDEF void bitbuf_read_uint16_array(bitbuf_cursor_t* read, uint16_t* out_values, size_t count);
+BITBUFDEF void bitbuf_read_uint8_array(bitbuf_cursor_t* read, uint8_t* out_values, size_t count);
+
+// read an integer written with bitbuf_write_ranged_int
+BITBUFDEF int64_t bitbuf_read_ranged_int(bitbuf_cursor_t* read, int64_t min, int64_t max);
+
+// delta compression of buffers that share a field layout, such as
+// successive snapshots of the same state.
+//
+// field_bits lists the width in bits of each field, in write order
+// (the num_bits passed to bitbuf_write_n_bits, or 8 * sizeof for typed
+// writes).  fields are at most 64 bits; split wider data into several
+// fields.  baseline and current must both hold at least the bits of
+// the layout.
+//
+// the delta is a 'changed' bit, then if set, one bit per field
+// followed by the values of the changed fields.
+BITBUFDEF void bitbuf_write_delta(bitbuf_buffer_t*       buf,
+                                  const bitbuf_buffer_t* baseline,
+                                  const bitbuf_buffer_t* current,
+                                  const int*             field_bits,
+                                  size_t                 num_fields);
+
+// read a delta written by bitbuf_write_delta, writing the
+// reconstructed fields to out
+BITBUFDEF void bitbuf_read_delta(bitbuf_cursor_t*       read,
+                                 const bitbuf_buffer_t* baseline,
+                                 bitbuf_buffer_t*       out,
+                                 const int*             field_bits,
+                                 size_t                 num_fields);
+
+// number of bits needed to represent every integer in [min, max]
+BITBUFDEF int bitbuf_bits_for_range(int64_t min, int64_t max);
+
+// compile time equivalent of bitbuf_bits_for_range, for constant
+// ranges.  folds to a constant that can be passed to bitbuf_write_n_bits.
+#define BITBUF_BITS_FOR_RANGE(min, max)                                        \
+    BITBUF__BITS_FOR_U64((uint64_t)(max) - (uint64_t)(min))
+
+#define BITBUF__BITS_FOR_U8(x)                                                 \
+    ((x) >= 0x80 ? 8 : (x) >= 0x40 ? 7 : (x) >= 0x20 ? 6 : (x) >= 0x10 ? 5 :   \
+     (x) >= 0x08 ? 4 : (x) >= 0x04 ? 3 : (x) >= 0x02 ? 2 : (x) >= 0x01 ? 1 : 0)
+#define BITBUF__BITS_FOR_U16(x)                                                \
+    ((x) >> 8 ? 8 + BITBUF__BITS_FOR_U8((x) >> 8) : BITBUF__BITS_FOR_U8(x))
+#define BITBUF__BITS_FOR_U32(x)                                                \
+    ((x) >> 16 ? 16 + BITBUF__BITS_FOR_U16((x) >> 16) : BITBUF__BITS_FOR_U16(x))
+#define BITBUF__BITS_FOR_U64(x)                                                \
+    ((x) >> 32 ? 32 + BITBUF__BITS_FOR_U32((x) >> 32) : BITBUF__BITS_FOR_U32(x))
+
 // read a quantized float
 BITBUFDEF float
 bitbuf_read_quantized_float(bitbuf_cursor_t* read, int num_bits, float min, float max);
 
-// advanced: initialize a buffer with *bytes, avoiding buffer allocation and
-// a copy.  num_bytes must be a multiple of 8.
+// quantize and write an array of floats, each exactly as
+// bitbuf_write_quantized_float would.  quantization is vectorized with
+// SSE2, AVX2 or NEON where available.
+BITBUFDEF void bitbuf_write_quantized_float_array(bitbuf_buffer_t* buf,
+                                                  int              num_bits,
+                                                  float            min,
+                                                  float            max,
+                                                  const float*     values,
+                                                  size_t           count);
+
+// read an array of floats written with bitbuf_write_quantized_float_array
+// or bitbuf_write_quantized_float
+BITBUFDEF void bitbuf_read_quantized_float_array(bitbuf_cursor_t* read,
+                                                 int              num_bits,
+                                                 float            min,
+                                                 float            max,
+                                                 float*           out_values,
+                                                 size_t           count);
+
+// 16-bit floats, for unbounded values that do not need full precision.
+//
+// half is IEEE 754 binary16: 11 bits of precision, magnitudes up to
+// 65504 and subnormals down to 2^-24.  bfloat16 keeps the exponent
+// range of a float with 8 bits of precision.
+//
+// both round to nearest even.  out of range values become infinity
+// and NaNs stay NaN (quieted).  the array variants convert with F16C
+// or NEON where available and produce the same bits as the scalar
+// versions.
+BITBUFDEF void  bitbuf_write_half(bitbuf_buffer_t* buf, float value);
+BITBUFDEF float bitbuf_read_half(bitbuf_cursor_t* read);
+BITBUFDEF void  bitbuf_write_bfloat16(bitbuf_buffer_t* buf, float value);
+BITBUFDEF float bitbuf_read_bfloat16(bitbuf_cursor_t* read);
+
+BITBUFDEF void bitbuf_write_half_array(bitbuf_buffer_t* buf, const float* values, size_t count);
+BITBUFDEF void bitbuf_read_half_array(bitbuf_cursor_t* read, float* out_values, size_t count);
+BITBUFDEF void
+bitbuf_write_bfloat16_array(bitbuf_buffer_t* buf, const float* values, size_t count);
+BITBUFDEF void
+bitbuf_read_bfloat16_array(bitbuf_cursor_t* read, float* out_values, size_t count);
+
+// quantized vec3, with min and max shared by all three axes.  each axis
+// is quantized exactly as bitbuf_write_quantized_float would.
+BITBUFDEF void bitbuf_write_quantized_vec3(
+    bitbuf_buffer_t* buf, int num_bits, float min, float max, const float v[3]);
+BITBUFDEF void bitbuf_read_quantized_vec3(
+    bitbuf_cursor_t* read, int num_bits, float min, float max, float out_v[3]);
+
+// quantized vec3 with a precision and range per axis
+BITBUFDEF void bitbuf_write_quantized_vec3_axes(bitbuf_buffer_t* buf,
+                                                const int        num_bits[3],
+                                                const float      min[3],
+                                                const float      max[3],
+                                                const float      v[3]);
+BITBUFDEF void bitbuf_read_quantized_vec3_axes(bitbuf_cursor_t* read,
+                                               const int        num_bits[3],
+                                               const float      min[3],
+                                               const float      max[3],
+                                               float            out_v[3]);
+
+// unit quaternion (x, y, z, w) in 2 + 3 * num_bits bits, using
+// smallest-three compression: the index of the largest component is
+// written, followed by the other three quantized to num_bits each.
+// the largest component is rebuilt on read from the unit length.
+//
+// q and -q are the same rotation, so the sign of the returned
+// quaternion may be flipped.
+BITBUFDEF void bitbuf_write_quat(bitbuf_buffer_t* buf, int num_bits, const float q[4]);
+BITBUFDEF void bitbuf_read_quat(bitbuf_cursor_t* read, int num_bits, float out_q[4]);
+
+// array variants.  vecs holds count * 3 floats and quats holds
+// count * 4 floats, interleaved.  capacity is reserved once for the
+// whole array.
+BITBUFDEF void bitbuf_write_quantized_vec3_array(bitbuf_buffer_t* buf,
+                                                 int              num_bits,
+                                                 float            min,
+                                                 float            max,
+                                                 const float*     vecs,
+                                                 size_t           count);
+BITBUFDEF void bitbuf_read_quantized_vec3_array(bitbuf_cursor_t* read,
+                                                int              num_bits,
+                                                float            min,
+                                                float            max,
+                                                float*           out_vecs,
+                                                size_t           count);
+BITBUFDEF void bitbuf_write_quantized_vec3_axes_array(bitbuf_buffer_t* buf,
+                                                      const int        num_bits[3],
+                                                      const float      min[3],
+                                                      const float      max[3],
+                                                      const float*     vecs,
+                                                      size_t           count);
+BITBUFDEF void bitbuf_read_quantized_vec3_axes_array(bitbuf_cursor_t* read,
+                                                     const int        num_bits[3],
+                                                     const float      min[3],
+                                                     const float      max[3],
+                                                     float*           out_vecs,
+                                                     size_t           count);
+BITBUFDEF void bitbuf_write_quat_array(bitbuf_buffer_t* buf,
+                                       int              num_bits,
+                                       const float*     quats,
+                                       size_t           count);
+BITBUFDEF void bitbuf_read_quat_array(bitbuf_cursor_t* read,
+                                      int              num_bits,
+                                      float*           out_quats,
+                                      size_t           count);
+
+// advanced: initialize a read-only buffer with *bytes, avoiding buffer
+// allocation and a copy.  bytes may have any alignment and num_bytes
+// any length, so received datagrams can be read in place.  reads past
+// num_bytes fail as they do for allocated buffers, and never touch
+// memory past the end of bytes.
+//
+// bitbuf_reader_t checks bounds per 64-bit segment, so on a buffer
+// whose length is not a multiple of 8, the bits of the final partial
+// segment past num_bytes read as zero.
 //
 // do not call bitbuf_free_buffer() on the returned buffer.
 BITBUFDEF bitbuf_buffer_t bitbuf_init_buffer_with_bytes(const uint8_t* bytes,
                                                         size_t num_bytes);
 
+// fragmentation of messages too large for one packet.
+//
+// a message is split into up to BITBUF_MAX_FRAGMENTS fragments of
+// fragment_bytes payload each, the last one shorter.  each fragment is
+// a header -- 16-bit message id, 8-bit index, 8-bit last index and the
+// fragment size as a varint, plus the bit length of the final fragment
+// on that one -- padded to a byte, followed by the payload.  headers
+// of fragments under 16KiB are 5-9 bytes.
+//
+// bitbuf_write_fragment writes a whole fragment to a packet buffer.
+// to send without copying the payload, write only the header and pass
+// it with bitbuf_fragment_payload to bitbuf_export_iovec.
+#define BITBUF_MAX_FRAGMENTS 256
+
+typedef struct {
+    const bitbuf_buffer_t* message;
+    size_t                 num_bits;
+    size_t                 fragment_bytes;
+    int                    num_fragments;
+    uint16_t               message_id;
+} bitbuf_fragmenter_t;
+
+// message must not be written to while it is being fragmented
+BITBUFDEF bitbuf_fragmenter_t bitbuf_fragmenter_init(const bitbuf_buffer_t* message,
+                                                     uint16_t               message_id,
+                                                     size_t                 fragment_bytes);
+
+BITBUFDEF void
+bitbuf_write_fragment(bitbuf_buffer_t* buf, const bitbuf_fragmenter_t* frag, int index);
+BITBUFDEF void
+bitbuf_write_fragment_header(bitbuf_buffer_t* buf, const bitbuf_fragmenter_t* frag, int index);
+
+// read-only view of the payload bytes of a fragment, inside the
+// message.  do not call bitbuf_free_buffer() on it.  stream bytes are
+// only in memory order on little-endian targets; elsewhere the view is
+// empty, and fragments must be sent with bitbuf_write_fragment.
+BITBUFDEF bitbuf_buffer_t bitbuf_fragment_payload(const bitbuf_fragmenter_t* frag, int index);
+
+// reassembles the fragments of one message, in any order, directly
+// into a destination buffer.  the destination must be empty and hold
+// the whole message.  it is complete once every fragment is added, at
+// which point its write cursor is at the end of the message.  until
+// then the write cursor is at the end of the furthest fragment added,
+// so a destination freed with the message incomplete is still cleared
+// by bitbuf_free_buffer if it is pooled.
+typedef struct {
+    bitbuf_buffer_t* dest;
+    uint64_t         received[BITBUF_MAX_FRAGMENTS / 64];
+    size_t           fragment_bytes;
+    int              num_fragments;
+    int              num_received;
+    uint16_t         message_id;
+
+    // length of the message, known once the final fragment is added
+    size_t num_bits;
+} bitbuf_reassembler_t;
+
+BITBUFDEF bitbuf_reassembler_t bitbuf_reassembler_init(bitbuf_buffer_t* dest);
+
+// read one fragment at the cursor into the destination.  returns false
+// if the fragment is malformed, a duplicate, from a different message
+// or does not fit the destination.  the cursor is left after the
+// payload unless the fragment is malformed.
+BITBUFDEF bool bitbuf_reassembler_add(bitbuf_reassembler_t* reasm, bitbuf_cursor_t* read);
+
+BITBUFDEF bool bitbuf_reassembler_is_complete(const bitbuf_reassembler_t* reasm);
+
+// advanced: fast writer for hot loops.
+//
+// pending bits are held in a register and flushed to the buffer a
+// whole 64-bit segment at a time, so capacity is checked once per
+// flush rather than once per field.
+//
+// bitbuf_writer_begin() takes over the buffer's write cursor and
+// bitbuf_writer_end() hands it back.  Do not call other bitbuf_write_*
+// functions on the buffer in between.
+//
+// truncation is detected on flush, so up to 63 bits written ahead of
+// the overflowing field may also be dropped.
+typedef struct {
+    // pending bits, starting at bit 0
+    uint64_t accum;
+
+    // number of pending bits in accum, <= 63
+    int accum_bits;
+
+    // next segment to flush to, and one past the last segment
+    uint64_t* seg;
+    uint64_t* end;
+
+    bitbuf_buffer_t* owner;
+} bitbuf_writer_t;
+
+BITBUFDEF bitbuf_writer_t bitbuf_writer_begin(bitbuf_buffer_t* buf);
+
+// flush pending bits and update the buffer's write cursor
+BITBUFDEF void bitbuf_writer_end(bitbuf_writer_t* writer);
+
+// out-of-line slow path for bitbuf_writer_write_n_bits
+BITBUFDEF void bitbuf__writer_flush_slow(bitbuf_writer_t* writer);
+
+// write n bits (up to 64).  value must not have bits set above num_bits.
+static BITBUF_INLINE void
+bitbuf_writer_write_n_bits(bitbuf_writer_t* writer, int num_bits, uint64_t value)
+{
+    int free_bits = 64 - writer->accum_bits;
+
+    writer->accum |= value << writer->accum_bits;
+    if (num_bits < free_bits) {
+        writer->accum_bits += num_bits;
+        return;
+    }
+
+    if (writer->seg != writer->end) {
+        *writer->seg++ = writer->accum;
+    } else {
+        bitbuf__writer_flush_slow(writer);
+    }
+
+    // free_bits is 1..64; split the shift so 64 does not overflow
+    writer->accum = (value >> 1) >> (free_bits - 1);
+    writer->accum_bits = num_bits - free_bits;
+}
+
+// advanced: fast reader for hot loops.
+//
+// the current and next 64-bit segments are cached, so a read is a
+// mask and a shift, with an out-of-line refill when the current
+// segment runs out.
+//
+// like a cursor, any number of readers may read a buffer once writing
+// is complete.
+typedef struct {
+    // unread bits of the current segment, starting at bit 0
+    uint64_t cur;
+
+    // the segment following cur
+    uint64_t next;
+
+    // number of unread bits in cur
+    int cur_bits;
+
+    // segment index that next was loaded from, and the number of
+    // readable segments
+    size_t next_seg;
+    size_t num_segs;
+
+    // the final segment, which may be partial, zero extended
+    uint64_t last;
+
+    const bitbuf_buffer_t* owner;
+
+    // set to 1 if an attempt to read past the end of the buffer was
+    // made
+    int read_past_end;
+} bitbuf_reader_t;
+
+// init a reader at the start of the buffer.  As with
+// bitbuf_cursor_init, the buffer may no longer be written to.
+BITBUFDEF bitbuf_reader_t bitbuf_reader_init(bitbuf_buffer_t* buffer);
+
+// init a reader at a cursor's position
+BITBUFDEF bitbuf_reader_t bitbuf_reader_init_at(const bitbuf_cursor_t* cursor);
+
+// return a cursor at the reader's position, for reading with
+// bitbuf_read_* routines
+BITBUFDEF bitbuf_cursor_t bitbuf_reader_get_cursor(const bitbuf_reader_t* reader);
+
+// skip byte padding generated by bitbuf_pad_to_byte
+BITBUFDEF void bitbuf_reader_skip_byte_padding(bitbuf_reader_t* reader);
+
+// out-of-line slow path for bitbuf_reader_read_n_bits
+BITBUFDEF uint64_t bitbuf__reader_read_slow(bitbuf_reader_t* reader, int num_bits);
+
+static BITBUF_INLINE uint64_t
+bitbuf__low_mask(int num_bits)
+{
+    return num_bits < 64 ? (1ull << num_bits) - 1 : ~0ull;
+}
+
+// read n bits (up to 64)
+static BITBUF_INLINE uint64_t
+bitbuf_reader_read_n_bits(bitbuf_reader_t* reader, int num_bits)
+{
+    if (num_bits <= reader->cur_bits) {
+        uint64_t value = reader->cur & bitbuf__low_mask(num_bits);
+
+        reader->cur = num_bits < 64 ? reader->cur >> num_bits : 0;
+        reader->cur_bits -= num_bits;
+
+        return value;
+    }
+
+    return bitbuf__reader_read_slow(reader, num_bits);
+}
+
+// as bitbuf_read_rice and the elias readers, decoding from the
+// reader's cached segment
+BITBUFDEF uint64_t bitbuf_reader_read_rice(bitbuf_reader_t* reader, int k);
+BITBUFDEF uint64_t bitbuf_reader_read_elias_gamma(bitbuf_reader_t* reader);
+BITBUFDEF uint64_t bitbuf_reader_read_elias_delta(bitbuf_reader_t* reader);
+
+// adaptive binary range coder, for fields with skewed distributions
+// that bit packing cannot shrink, such as mostly false bools or
+// enums dominated by one value.
+//
+// each field is coded against a probability model, bitbuf_prob_t,
+// that adapts to the values it has seen.  give every context its own
+// models, initialized with bitbuf_init_probs.  the reader must use
+// models initialized the same way, in the same order.
+//
+// coded bytes are written to a bitbuffer, so a range coded section can
+// follow or precede ordinary fields.  the decoder reads exactly the
+// bytes the encoder wrote, leaving its cursor after them.
+typedef uint16_t bitbuf_prob_t;
+
+#define BITBUF_PROB_BITS 11
+#define BITBUF_PROB_INIT (1 << (BITBUF_PROB_BITS - 1))
+
+// number of models for bitbuf_range_encode_uint
+#define BITBUF_RANGE_UINT_PROBS 128
+
+BITBUFDEF void bitbuf_init_probs(bitbuf_prob_t* probs, size_t count);
+
+typedef struct {
+    bitbuf_buffer_t* buf;
+    uint64_t         low;
+    uint32_t         range;
+
+    // bytes not yet written, as a carry may still reach them: cache,
+    // followed by cache_size - 1 0xff bytes
+    uint8_t cache;
+    size_t  cache_size;
+
+    // the first byte out is always zero, and is not written
+    int first_byte;
+} bitbuf_range_encoder_t;
+
+typedef struct {
+    bitbuf_cursor_t* read;
+    uint32_t         range;
+    uint32_t         code;
+} bitbuf_range_decoder_t;
+
+BITBUFDEF bitbuf_range_encoder_t bitbuf_range_encoder_begin(bitbuf_buffer_t* buf);
+
+// flush the bytes the coder still holds
+BITBUFDEF void bitbuf_range_encoder_end(bitbuf_range_encoder_t* enc);
+
+BITBUFDEF void bitbuf_range_encode_bit(bitbuf_range_encoder_t* enc, bitbuf_prob_t* prob, int bit);
+
+// code the num_bits (1-16) bit symbol most significant bit first, each
+// bit modelled in the context of the bits above it.  probs holds
+// 1 << num_bits models.
+BITBUFDEF void bitbuf_range_encode_symbol(bitbuf_range_encoder_t* enc,
+                                          bitbuf_prob_t*          probs,
+                                          int                     num_bits,
+                                          uint32_t                symbol);
+
+// code the bit width of value against BITBUF_RANGE_UINT_PROBS models,
+// followed by the bits below its leading one, uncompressed.  suits
+// counts and sizes that are usually small.
+BITBUFDEF void
+bitbuf_range_encode_uint(bitbuf_range_encoder_t* enc, bitbuf_prob_t* probs, uint64_t value);
+
+// code bits with a fixed 50% probability, for values with no skew
+BITBUFDEF void
+bitbuf_range_encode_direct(bitbuf_range_encoder_t* enc, int num_bits, uint64_t value);
+
+// begins by reading 4 bytes at the cursor
+BITBUFDEF bitbuf_range_decoder_t bitbuf_range_decoder_begin(bitbuf_cursor_t* read);
+
+BITBUFDEF int bitbuf_range_decode_bit(bitbuf_range_decoder_t* dec, bitbuf_prob_t* prob);
+BITBUFDEF uint32_t bitbuf_range_decode_symbol(bitbuf_range_decoder_t* dec,
+                                              bitbuf_prob_t*          probs,
+                                              int                     num_bits);
+BITBUFDEF uint64_t bitbuf_range_decode_uint(bitbuf_range_decoder_t* dec, bitbuf_prob_t* probs);
+BITBUFDEF uint64_t bitbuf_range_decode_direct(bitbuf_range_decoder_t* dec, int num_bits);
+
+// static frequency rANS coding of byte arrays, for large payloads such
+// as level snapshots.  symbol frequencies are counted and sent with
+// the block, so it suits data with a skewed byte distribution.
+//
+// the block is byte aligned, padding the write cursor first:
+// the count as a varint, a 256-bit mask of the bytes present, 12 bits
+// per present byte for its frequency, then the coded 16-bit words of
+// 8 interleaved rANS streams.  decoding interleaves the streams four to
+// a vector where SSE4.1 is available.
+BITBUFDEF void bitbuf_write_rans_bytes(bitbuf_buffer_t* buf, const uint8_t* bytes, size_t count);
+
+// decode a block written by bitbuf_write_rans_bytes into out_bytes,
+// returning the number of bytes decoded.  if the block holds more than
+// max_count bytes or is corrupt, read_past_end is set and 0 returned.
+BITBUFDEF size_t bitbuf_read_rans_bytes(bitbuf_cursor_t* read,
+                                        uint8_t*         out_bytes,
+                                        size_t           max_count);
+
+// elias-fano coding of non-decreasing sequences, such as sorted entity
+// ids.  each value is split into low bits, packed, and high bits,
+// coded as unary gaps in a bit vector, for about 2 + log2(max / count)
+// bits per value.
+//
+// the block is the count as a varint, the low bit width in 6 bits, the
+// high part of the largest value as a varint, then the low bits and
+// the high bits.  bitbuf_read_elias_fano reads only this header and
+// leaves the cursor after the block; values are decoded in place, so
+// a receiver can iterate or skip without decoding the whole block.
+typedef struct {
+    const bitbuf_buffer_t* owner;
+
+    // bit offsets of the low and high bits in owner, and the length of
+    // the high bits
+    size_t low_pos;
+    size_t high_pos;
+    size_t high_len;
+
+    size_t count;
+    int    low_bits;
+
+    // number of values returned
+    size_t index;
+
+    // the high bits at word_pos, less those of returned values, and
+    // the number of set high bits before word_pos
+    size_t   word_pos;
+    uint64_t word;
+    size_t   ones_before;
+} bitbuf_elias_fano_t;
+
+// values must be non-decreasing; if they are not, an empty sequence is
+// written
+BITBUFDEF void
+bitbuf_write_elias_fano(bitbuf_buffer_t* buf, const uint64_t* values, size_t count);
+
+// if the block is malformed, read_past_end is set and the returned
+// sequence is empty
+BITBUFDEF bitbuf_elias_fano_t bitbuf_read_elias_fano(bitbuf_cursor_t* read);
+
+// the next value of the sequence.  returns false at its end.
+BITBUFDEF bool bitbuf_elias_fano_next(bitbuf_elias_fano_t* ef, uint64_t* out_value);
+
+// the next value that is at least target.  high bits are skipped a
+// word at a time, by popcount.  returns false if there is none.
+BITBUFDEF bool
+bitbuf_elias_fano_next_geq(bitbuf_elias_fano_t* ef, uint64_t target, uint64_t* out_value);
+
+// the value at index, without changing the position of next
+BITBUFDEF uint64_t bitbuf_elias_fano_get(const bitbuf_elias_fano_t* ef, size_t index);
+
+// frame of reference coding of uint32 arrays, for columns such as
+// health, ammo or tick stamps whose values are close together within
+// a block.
+//
+// values are coded in blocks of BITBUF_PFOR_BLOCK, the final block
+// padded.  each block stores its minimum, and each value's difference
+// from it at the bit width that makes the block smallest.  the few
+// differences too wide for it are patched in from a list of
+// exceptions.
+//
+// the array is byte aligned, padding the write cursor first: the count
+// as a varint, then per block 7 bytes of minimum and widths, 16 bytes
+// per bit of width of packed differences, and the exceptions.  packed
+// differences are interleaved so that value i is in 32-bit lane i % 4,
+// and unpack four at a time with SSE2, in place in the buffer.
+#define BITBUF_PFOR_BLOCK 128
+
+BITBUFDEF void bitbuf_write_pfor_u32(bitbuf_buffer_t* buf, const uint32_t* values, size_t count);
+
+// decode an array written by bitbuf_write_pfor_u32 into out_values,
+// returning the number of values decoded.  if the array holds more
+// than max_count values or is corrupt, read_past_end is set and 0
+// returned.
+BITBUFDEF size_t bitbuf_read_pfor_u32(bitbuf_cursor_t* read,
+                                      uint32_t*        out_values,
+                                      size_t           max_count);
+
+#ifdef BITBUF_BENCHMARKS_ENABLED
+// time bitbuffer hot paths, printing results to stdout
+BITBUFDEF void bitbuf_run_benchmarks(void);
+#endif
+
 //
 // End of header file
 //
@@ -324,8 +1153,34 @@ BITBUFDEF bitbuf_buffer_t bitbuf_init_buffer_with_bytes(const uint8_t* bytes,
 /* implementation */
 #if defined(FTG_IMPLEMENT_BITBUFFER)
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef BITBUF_HAS_IOVEC
+#    include <sys/uio.h>
+#endif
+
+#if defined(__BMI2__) || defined(__AVX2__) || defined(__F16C__)
+#    include <immintrin.h>
+#endif
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && defined(__AVX__))
+#    include <smmintrin.h>
+#    define BITBUF__SSE41
+#endif
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#    define BITBUF__F16C
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define BITBUF__SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#    include <arm_neon.h>
+#    define BITBUF__NEON
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#    include <intrin.h>
+#    define BITBUF__MSVC_BITSCAN
+#endif
 
 #define BITBUF__SEG_BITS 64
 
@@ -336,6 +1191,57 @@ BITBUFDEF bitbuf_buffer_t bitbuf_init_buffer_with_bytes(const uint8_t* bytes,
 #define BITBUF__MAX(a, b) ((a) > (b) ? (a) : (b))
 #define BITBUF__MIN(a, b) ((a) < (b) ? (a) : (b))
 
+#if defined(__GNUC__) || defined(__clang__)
+#    define BITBUF__NOINLINE __attribute__((noinline))
+#    define BITBUF__FORCEINLINE BITBUF_INLINE __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#    define BITBUF__NOINLINE __declspec(noinline)
+#    define BITBUF__FORCEINLINE __forceinline
+#else
+#    define BITBUF__NOINLINE
+#    define BITBUF__FORCEINLINE BITBUF_INLINE
+#endif
+
+// segments are stored in native byte order, so on little endian
+// targets the bytes of the stream are in memory order and byte
+// aligned runs can be copied directly.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#    define BITBUF__LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#elif defined(_WIN32) || defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86) || defined(_M_ARM64)
+#    define BITBUF__LITTLE_ENDIAN 1
+#else
+#    define BITBUF__LITTLE_ENDIAN 0
+#endif
+
+// load/store 8 bytes of the stream as a 64-bit word, from any alignment
+static BITBUF_INLINE uint64_t
+bitbuf__load_le64(const uint8_t* p)
+{
+#if BITBUF__LITTLE_ENDIAN
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+#else
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+           ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+           ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+#endif
+}
+
+static BITBUF_INLINE void
+bitbuf__store_le64(uint8_t* p, uint64_t word)
+{
+#if BITBUF__LITTLE_ENDIAN
+    memcpy(p, &word, sizeof(word));
+#else
+    int i;
+    for (i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(word >> (i * 8));
+    }
+#endif
+}
+
 #define BITBUF__ASSERT_NO_WRITE_AFTER_READS(BUF)                               \
     BITBUF__ASSERT((BUF)->write.owner == NULL)
 
@@ -391,12 +1297,113 @@ static const uint64_t bitbuf__spanmasktable[65] = {
     (1ull << 57) - 1, (1ull << 58) - 1, (1ull << 59) - 1, (1ull << 60) - 1,
     (1ull << 61) - 1, (1ull << 62) - 1, 0x7fffffffffffffff, 0xffffffffffffffff,
 };
+
+// continuation bit positions of varints for each group width
+static const uint64_t bitbuf__varint_contmasktable[64] = {
+    0, 0xaaaaaaaaaaaaaaaaull, 0x4924924924924924ull, 0x8888888888888888ull,
+    0x0842108421084210ull, 0x0820820820820820ull, 0x4081020408102040ull, 0x8080808080808080ull,
+    0x4020100804020100ull, 0x0802008020080200ull, 0x0040080100200400ull, 0x0800800800800800ull,
+    0x0008004002001000ull, 0x0080020008002000ull, 0x0800100020004000ull, 0x8000800080008000ull,
+    0x0004000200010000ull, 0x0020000800020000ull, 0x0100002000040000ull, 0x0800008000080000ull,
+    0x4000020000100000ull, 0x0000080000200000ull, 0x0000200000400000ull, 0x0000800000800000ull,
+    0x0002000001000000ull, 0x0008000002000000ull, 0x0020000004000000ull, 0x0080000008000000ull,
+    0x0200000010000000ull, 0x0800000020000000ull, 0x2000000040000000ull, 0x8000000080000000ull,
+    0x0000000100000000ull, 0x0000000200000000ull, 0x0000000400000000ull, 0x0000000800000000ull,
+    0x0000001000000000ull, 0x0000002000000000ull, 0x0000004000000000ull, 0x0000008000000000ull,
+    0x0000010000000000ull, 0x0000020000000000ull, 0x0000040000000000ull, 0x0000080000000000ull,
+    0x0000100000000000ull, 0x0000200000000000ull, 0x0000400000000000ull, 0x0000800000000000ull,
+    0x0001000000000000ull, 0x0002000000000000ull, 0x0004000000000000ull, 0x0008000000000000ull,
+    0x0010000000000000ull, 0x0020000000000000ull, 0x0040000000000000ull, 0x0080000000000000ull,
+    0x0100000000000000ull, 0x0200000000000000ull, 0x0400000000000000ull, 0x0800000000000000ull,
+    0x1000000000000000ull, 0x2000000000000000ull, 0x4000000000000000ull, 0x8000000000000000ull,
+};
 /* clang-format on */
 
+// number of bits needed to represent value; 0 for 0
+static BITBUF_INLINE int
+bitbuf__bit_width(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return value ? 64 - __builtin_clzll(value) : 0;
+#elif defined(BITBUF__MSVC_BITSCAN)
+    unsigned long index;
+    return _BitScanReverse64(&index, value) ? (int)index + 1 : 0;
+#else
+    int width = 0;
+    while (value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+#endif
+}
+
+// index of the lowest set bit.  value must not be 0.
+static BITBUF_INLINE int
+bitbuf__ctz64(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#elif defined(BITBUF__MSVC_BITSCAN)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    int index = 0;
+    while ((value & 1) == 0) {
+        index++;
+        value >>= 1;
+    }
+    return index;
+#endif
+}
+
+// number of set bits
+static BITBUF_INLINE int
+bitbuf__popcount64(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(value);
+#else
+    value -= (value >> 1) & 0x5555555555555555ull;
+    value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+    value = (value + (value >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((value * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// index of the set bit of value with rank set bits below it.  value
+// must have more than rank bits set.
+static BITBUF_INLINE int
+bitbuf__select64(uint64_t value, int rank)
+{
+#if defined(__BMI2__)
+    return bitbuf__ctz64(_pdep_u64(1ull << rank, value));
+#else
+    for (; rank > 0; rank--) {
+        value &= value - 1;
+    }
+    return bitbuf__ctz64(value);
+#endif
+}
+
+static BITBUF_INLINE uint64_t
+bitbuf__zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (0 - ((uint64_t)value >> 63));
+}
+
+static BITBUF_INLINE int64_t
+bitbuf__zigzag_decode(uint64_t value)
+{
+    return (int64_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
 BITBUFDEF bitbuf_buffer_t
 bitbuf_alloc_buffer(size_t max_bytes)
 {
     bitbuf_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
 
     BITBUF__ASSERT(max_bytes > 0);
 
@@ -416,36 +1423,99 @@ bitbuf_alloc_buffer(size_t max_bytes)
 }
 
 BITBUFDEF bitbuf_buffer_t
-bitbuf_alloc_buffer_with_bytes(const uint8_t* bytes, size_t num_bytes)
+bitbuf_alloc_growable_buffer(size_t initial_bytes)
 {
-    // perf: zeroes memory, then copies over it
-    bitbuf_buffer_t buffer = bitbuf_alloc_buffer(num_bytes);
-    memcpy(buffer.data, bytes, sizeof(uint8_t) * num_bytes);
-
-    size_t segment = num_bytes / sizeof(uint64_t);
-    int    bits_into_seg = (num_bytes % sizeof(uint64_t)) * 8;
-
-    buffer.write.seg = buffer.data + segment;
-    buffer.write.bits_into_seg = bits_into_seg;
+    bitbuf_buffer_t buffer = bitbuf_alloc_buffer(initial_bytes);
+    buffer.growable = 1;
 
     return buffer;
 }
 
+#ifdef FTG__INCLUDE_CORE_H
 BITBUFDEF bitbuf_buffer_t
-bitbuf_init_buffer_with_bytes(const uint8_t* bytes, size_t num_bytes)
+bitbuf_alloc_growable_buffer_in_arena(struct ftg_arena_s** arena, size_t initial_bytes)
 {
-    BITBUF__ASSERT((num_bytes % 8) == 0);
-
     bitbuf_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
 
-    buffer.data = (uint64_t*)bytes;
-    buffer.capacity_bytes = num_bytes;
+    BITBUF__ASSERT(arena && *arena);
+    BITBUF__ASSERT(initial_bytes > 0);
 
-    buffer.write.seg = buffer.data;
-    buffer.write.bits_into_seg = 0;
-    buffer.write.owner = NULL;
+    buffer.capacity_bytes = BITBUF__ALIGN_UP(initial_bytes, 8);
 
-    buffer.truncated = 0;
+    buffer.data = (uint64_t*)ftg_arena_alloc(arena, buffer.capacity_bytes);
+    memset(buffer.data, 0, buffer.capacity_bytes);
+
+    buffer.write.seg = buffer.data;
+    buffer.growable = 1;
+    buffer.arena = arena;
+
+    return buffer;
+}
+#endif
+
+BITBUFDEF bitbuf_buffer_t
+bitbuf_alloc_buffer_with_bytes(const uint8_t* bytes, size_t num_bytes)
+{
+    bitbuf_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
+
+    BITBUF__ASSERT(num_bytes > 0);
+
+    buffer.capacity_bytes = BITBUF__ALIGN_UP(num_bytes, 8);
+    buffer.data = (uint64_t*)BITBUF_MALLOC(buffer.capacity_bytes);
+
+    // only the tail of the final segment needs zeroing
+    memcpy(buffer.data, bytes, sizeof(uint8_t) * num_bytes);
+    memset((uint8_t*)buffer.data + num_bytes, 0, buffer.capacity_bytes - num_bytes);
+
+    size_t segment = num_bytes / sizeof(uint64_t);
+    int    bits_into_seg = (num_bytes % sizeof(uint64_t)) * 8;
+
+    buffer.write.seg = buffer.data + segment;
+    buffer.write.bits_into_seg = bits_into_seg;
+
+    return buffer;
+}
+
+BITBUFDEF bitbuf_buffer_t
+bitbuf_init_measure_buffer(void)
+{
+    bitbuf_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
+
+    // with no capacity, every write takes the reserve slow path, which
+    // does the counting
+    buffer.measuring = 1;
+
+    return buffer;
+}
+
+BITBUFDEF size_t
+bitbuf_num_bits_written(const bitbuf_buffer_t* buf)
+{
+    if (buf->measuring)
+        return buf->measured_bits;
+
+    return (size_t)(buf->write.seg - buf->data) * BITBUF__SEG_BITS + buf->write.bits_into_seg;
+}
+
+BITBUFDEF bitbuf_buffer_t
+bitbuf_init_buffer_with_bytes(const uint8_t* bytes, size_t num_bytes)
+{
+    bitbuf_buffer_t buffer;
+    memset(&buffer, 0, sizeof(buffer));
+
+    // data may be unaligned, and is only accessed with bitbuf__load_seg
+    buffer.data = (uint64_t*)bytes;
+    buffer.capacity_bytes = num_bytes;
+
+    // the buffer is full, so writes truncate
+    buffer.write.seg = buffer.data + num_bytes / sizeof(uint64_t);
+    buffer.write.bits_into_seg = (int)(num_bytes % sizeof(uint64_t)) * 8;
+    buffer.write.owner = NULL;
+
+    buffer.truncated = 0;
 
     return buffer;
 }
@@ -456,6 +1526,205 @@ bitbuf_has_truncated(const bitbuf_buffer_t* buffer)
     return buffer->truncated == 1;
 }
 
+#ifndef BITBUF_POOL_CACHE_MAX
+#    define BITBUF_POOL_CACHE_MAX 32
+#endif
+
+#define BITBUF__POOL_MIN_SHIFT 6
+#define BITBUF__POOL_NUM_CLASSES 11
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#    define BITBUF__THREAD_LOCAL __declspec(thread)
+#else
+#    define BITBUF__THREAD_LOCAL __thread
+#endif
+
+// free pool storage is linked through its first word, which is zeroed
+// again when the storage is handed out
+typedef struct bitbuf__pool_node_s {
+    struct bitbuf__pool_node_s* next;
+} bitbuf__pool_node_t;
+
+typedef struct {
+    bitbuf__pool_node_t* head;
+    int                  count;
+} bitbuf__pool_cache_t;
+
+static BITBUF__THREAD_LOCAL bitbuf__pool_cache_t bitbuf__pool_caches[BITBUF__POOL_NUM_CLASSES];
+
+// shared lists are only ever pushed to, or taken whole with an
+// exchange, so popping cannot suffer from ABA
+static bitbuf__pool_node_t* volatile bitbuf__pool_shared[BITBUF__POOL_NUM_CLASSES];
+
+static BITBUF_INLINE size_t
+bitbuf__pool_class_bytes(int size_class)
+{
+    return (size_t)1 << (size_class + BITBUF__POOL_MIN_SHIFT);
+}
+
+// smallest size class holding num_bytes, or -1 if there is none
+static BITBUF_INLINE int
+bitbuf__pool_class(size_t num_bytes)
+{
+    int size_class = bitbuf__bit_width((uint64_t)(num_bytes - 1) >> BITBUF__POOL_MIN_SHIFT);
+
+    return size_class < BITBUF__POOL_NUM_CLASSES ? size_class : -1;
+}
+
+static BITBUF_INLINE bitbuf__pool_node_t*
+bitbuf__pool_take_shared(int size_class)
+{
+#if defined(_MSC_VER)
+    return (bitbuf__pool_node_t*)_InterlockedExchangePointer(
+        (void* volatile*)&bitbuf__pool_shared[size_class], NULL);
+#else
+    return __atomic_exchange_n(
+        &bitbuf__pool_shared[size_class], (bitbuf__pool_node_t*)NULL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// push the chain first..last onto a shared list
+static void
+bitbuf__pool_push_shared(int size_class, bitbuf__pool_node_t* first, bitbuf__pool_node_t* last)
+{
+    bitbuf__pool_node_t* head;
+
+#if defined(_MSC_VER)
+    do {
+        head = bitbuf__pool_shared[size_class];
+        last->next = head;
+    } while (_InterlockedCompareExchangePointer((void* volatile*)&bitbuf__pool_shared[size_class],
+                                                first, head) != head);
+#else
+    head = __atomic_load_n(&bitbuf__pool_shared[size_class], __ATOMIC_RELAXED);
+    do {
+        last->next = head;
+    } while (!__atomic_compare_exchange_n(&bitbuf__pool_shared[size_class], &head, first, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+}
+
+BITBUFDEF bitbuf_buffer_t
+bitbuf_alloc_pooled_buffer(size_t max_bytes)
+{
+    int                   size_class = bitbuf__pool_class(max_bytes);
+    bitbuf__pool_cache_t* cache;
+    bitbuf__pool_node_t*  node;
+    bitbuf_buffer_t       buffer;
+
+    BITBUF__ASSERT(max_bytes > 0);
+
+    if (size_class < 0)
+        return bitbuf_alloc_buffer(max_bytes);
+
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.capacity_bytes = bitbuf__pool_class_bytes(size_class);
+
+    cache = &bitbuf__pool_caches[size_class];
+    if (!cache->head) {
+        cache->head = bitbuf__pool_take_shared(size_class);
+
+        for (node = cache->head; node; node = node->next)
+            cache->count++;
+    }
+
+    node = cache->head;
+    if (node) {
+        cache->head = node->next;
+        cache->count--;
+        node->next = NULL;
+        buffer.data = (uint64_t*)node;
+    } else {
+        buffer.data = (uint64_t*)BITBUF_MALLOC(buffer.capacity_bytes);
+        memset(buffer.data, 0, buffer.capacity_bytes);
+    }
+
+    buffer.write.seg = buffer.data;
+    buffer.pooled = 1;
+
+    return buffer;
+}
+
+static void
+bitbuf__pool_release(bitbuf_buffer_t* buffer)
+{
+    int                   size_class = bitbuf__pool_class(buffer->capacity_bytes);
+    bitbuf__pool_cache_t* cache;
+    bitbuf__pool_node_t*  node = (bitbuf__pool_node_t*)buffer->data;
+    bitbuf__pool_node_t*  first;
+    bitbuf__pool_node_t*  last;
+    int                   keep, i;
+
+    // a growable pooled buffer may have outgrown its size class
+    if (size_class < 0 || bitbuf__pool_class_bytes(size_class) != buffer->capacity_bytes) {
+        BITBUF_FREE(buffer->data);
+        return;
+    }
+
+    // bits past the write cursor are never set
+    memset(buffer->data, 0, (bitbuf_num_bits_written(buffer) + 7) / 8);
+
+    cache = &bitbuf__pool_caches[size_class];
+    node->next = cache->head;
+    cache->head = node;
+
+    if (++cache->count <= BITBUF_POOL_CACHE_MAX)
+        return;
+
+    // keep the most recently freed half, which is likely still in cache
+    keep = cache->count / 2;
+    for (i = 1, last = node; i < keep; i++)
+        last = last->next;
+
+    first = last->next;
+    last->next = NULL;
+    cache->count = keep;
+
+    for (last = first; last->next; last = last->next) {
+    }
+    bitbuf__pool_push_shared(size_class, first, last);
+}
+
+BITBUFDEF void
+bitbuf_pool_flush_thread_cache(void)
+{
+    int size_class;
+
+    for (size_class = 0; size_class < BITBUF__POOL_NUM_CLASSES; size_class++) {
+        bitbuf__pool_cache_t* cache = &bitbuf__pool_caches[size_class];
+        bitbuf__pool_node_t*  last;
+
+        if (!cache->head)
+            continue;
+
+        for (last = cache->head; last->next; last = last->next) {
+        }
+        bitbuf__pool_push_shared(size_class, cache->head, last);
+
+        cache->head = NULL;
+        cache->count = 0;
+    }
+}
+
+BITBUFDEF void
+bitbuf_pool_trim(void)
+{
+    int size_class;
+
+    bitbuf_pool_flush_thread_cache();
+
+    for (size_class = 0; size_class < BITBUF__POOL_NUM_CLASSES; size_class++) {
+        bitbuf__pool_node_t* node = bitbuf__pool_take_shared(size_class);
+
+        while (node) {
+            bitbuf__pool_node_t* next = node->next;
+            BITBUF_FREE(node);
+            node = next;
+        }
+    }
+}
+
 BITBUFDEF void
 bitbuf_free_buffer(bitbuf_buffer_t* buffer)
 {
@@ -468,6 +1737,15 @@ bitbuf_free_buffer(bitbuf_buffer_t* buffer)
     BITBUF__ASSERT(!bitbuf_has_truncated(buffer));
 #endif
 
+    // arena storage is released with the arena
+    if (buffer->arena)
+        return;
+
+    if (buffer->pooled) {
+        bitbuf__pool_release(buffer);
+        return;
+    }
+
     BITBUF_FREE(buffer->data);
 }
 
@@ -476,6 +1754,11 @@ bitbuf_get_bytes_from_buffer(const bitbuf_buffer_t* buf, size_t* out_num_bytes)
 {
     BITBUF__ASSERT(out_num_bytes);
 
+    if (buf->measuring) {
+        *out_num_bytes = (buf->measured_bits + 7) / 8;
+        return NULL;
+    }
+
     *out_num_bytes = (buf->write.seg - buf->data) * sizeof(uint64_t);
     *out_num_bytes += BITBUF__ALIGN_UP(buf->write.bits_into_seg, 8) / 8;
 
@@ -485,6 +1768,9 @@ bitbuf_get_bytes_from_buffer(const bitbuf_buffer_t* buf, size_t* out_num_bytes)
 BITBUFDEF bitbuf_cursor_t
 bitbuf_cursor_init(bitbuf_buffer_t* buffer)
 {
+    // if this is hit, a measuring buffer is being read
+    BITBUF__ASSERT(!buffer->measuring);
+
     // set the writer owner to a legal non-NULL value, indicating that
     // writing is complete.
     buffer->write.owner = buffer;
@@ -516,13 +1802,115 @@ static ptrdiff_t
 bitbuf__bits_remaining_for_cursor(const bitbuf_buffer_t* buffer,
                                   const bitbuf_cursor_t* cursor)
 {
-    ptrdiff_t remaining_segs = (buffer->capacity_bytes / sizeof(uint64_t)) -
-                               (cursor->seg - buffer->data);
-    BITBUF__ASSERT(remaining_segs >= 0);
+    // capacity may end part way into a segment
+    ptrdiff_t read_bits = (cursor->seg - buffer->data) * BITBUF__SEG_BITS + cursor->bits_into_seg;
+
+    return (ptrdiff_t)(buffer->capacity_bytes * 8) - read_bits;
+}
+
+static BITBUF_INLINE const uint8_t*
+bitbuf__buffer_end(const bitbuf_buffer_t* buffer)
+{
+    return (const uint8_t*)buffer->data + buffer->capacity_bytes;
+}
+
+// the bytes of a partial final segment, zero extended.  kept out of
+// line so that it does not weigh down the read paths it is called from.
+static BITBUF__NOINLINE uint64_t
+bitbuf__load_partial_seg(const uint8_t* bytes, const uint8_t* end)
+{
+    uint64_t value = 0;
+
+    if (end > bytes)
+        memcpy(&value, bytes, (size_t)(end - bytes));
+
+    return value;
+}
+
+// load the segment at seg, where end is bitbuf__buffer_end.  buffers
+// from bitbuf_init_buffer_with_bytes may be unaligned and end part way
+// into a segment, so segments are loaded with memcpy, and a partial
+// final segment without reading past end.
+static BITBUF_INLINE uint64_t
+bitbuf__load_seg(const uint64_t* seg, const uint8_t* end)
+{
+    const uint8_t* bytes = (const uint8_t*)seg;
+    uint64_t       value;
+
+    if (end - bytes < (ptrdiff_t)sizeof(uint64_t))
+        return bitbuf__load_partial_seg(bytes, end);
+
+    memcpy(&value, bytes, sizeof(uint64_t));
+    return value;
+}
+
+// double the storage of a growable buffer until num_bits more bits fit,
+// zeroing the new space.  the write cursor is rebased onto the new
+// storage.
+static bool
+bitbuf__grow(bitbuf_buffer_t* buffer, size_t num_bits)
+{
+    size_t seg_offset = buffer->write.seg - buffer->data;
+    size_t used_bytes = seg_offset * sizeof(uint64_t) +
+                        BITBUF__ALIGN_UP(buffer->write.bits_into_seg, 8) / 8;
+    size_t needed_bytes = BITBUF__ALIGN_UP(
+        (seg_offset * BITBUF__SEG_BITS + buffer->write.bits_into_seg + num_bits + 7) / 8, 8);
+    size_t new_capacity = BITBUF__MAX(buffer->capacity_bytes, 8);
+    uint64_t* new_data;
+
+    while (new_capacity < needed_bytes)
+        new_capacity *= 2;
+
+#ifdef FTG__INCLUDE_CORE_H
+    if (buffer->arena) {
+        new_data = (uint64_t*)ftg_arena_alloc(buffer->arena, new_capacity);
+        if (new_data)
+            memcpy(new_data, buffer->data, used_bytes);
+    } else
+#endif
+    {
+#ifdef BITBUF_REALLOC
+        new_data = (uint64_t*)BITBUF_REALLOC(buffer->data, new_capacity);
+#else
+        new_data = (uint64_t*)BITBUF_MALLOC(new_capacity);
+        if (new_data) {
+            memcpy(new_data, buffer->data, used_bytes);
+            BITBUF_FREE(buffer->data);
+        }
+#endif
+    }
+
+    if (!new_data)
+        return false;
+
+    memset((uint8_t*)new_data + used_bytes, 0, new_capacity - used_bytes);
+
+    buffer->data = new_data;
+    buffer->capacity_bytes = new_capacity;
+    buffer->write.seg = new_data + seg_offset;
+
+    return true;
+}
+
+// slow path, called when num_bits do not fit in the remaining
+// capacity.  returns true if the buffer was grown to fit them.
+static bool
+bitbuf__reserve_slow(bitbuf_buffer_t* buffer, size_t num_bits)
+{
+    // measuring buffers count the bits, and the write is skipped
+    if (buffer->measuring) {
+        buffer->measured_bits += num_bits;
+        return false;
+    }
+
+    if (buffer->growable && bitbuf__grow(buffer, num_bits))
+        return true;
 
-    int remaining_bits = BITBUF__SEG_BITS - cursor->bits_into_seg;
+    if (!buffer->open_checkpoints)
+        BITBUF__ASSERT_FAIL("out of space writing bits");
+    buffer->truncated |= 1;
 
-    return (remaining_segs * BITBUF__SEG_BITS) + remaining_bits;
+    return false;
 }
 
 static bool
@@ -539,6 +1927,137 @@ bitbuf__advance_cursor(bitbuf_cursor_t* cursor)
     cursor->seg++;
 }
 
+// absolute bit offset of a cursor from the start of data
+static BITBUF_INLINE size_t
+bitbuf__cursor_pos(const bitbuf_cursor_t* cursor, const uint64_t* data)
+{
+    return (size_t)(cursor->seg - data) * BITBUF__SEG_BITS + cursor->bits_into_seg;
+}
+
+static BITBUF_INLINE void
+bitbuf__set_cursor_pos(bitbuf_cursor_t* cursor, uint64_t* data, size_t bit_pos)
+{
+    cursor->seg = data + bit_pos / BITBUF__SEG_BITS;
+    cursor->bits_into_seg = (int)(bit_pos % BITBUF__SEG_BITS);
+}
+
+// unchecked bit packer for bulk writes.  Capacity must already be
+// reserved.  Lives on the stack of the caller so its state stays in
+// registers.
+typedef struct {
+    uint64_t* seg;
+    uint64_t  accum;
+    int       accum_bits;
+} bitbuf__packer_t;
+
+// true if the write cursor is in a final partial segment, which only a
+// buffer from bitbuf_init_buffer_with_bytes has.  such a buffer is
+// full, and the segment may be unaligned and run past its bytes, so it
+// must not be dereferenced for writing.
+static BITBUF_INLINE bool
+bitbuf__write_in_partial_seg(const bitbuf_buffer_t* buffer)
+{
+    return buffer->write.bits_into_seg != 0 &&
+           buffer->write.seg == buffer->data + buffer->capacity_bytes / sizeof(uint64_t);
+}
+
+// nothing can be reserved in a partial segment, so a packer begun there
+// packs nothing, and bitbuf__packer_end leaves the segment alone
+static BITBUF_INLINE bitbuf__packer_t
+bitbuf__packer_begin(const bitbuf_buffer_t* buffer)
+{
+    bitbuf__packer_t packer;
+
+    packer.seg = buffer->write.seg;
+    packer.accum_bits = buffer->write.bits_into_seg;
+    packer.accum =
+        packer.accum_bits && !bitbuf__write_in_partial_seg(buffer) ? *packer.seg : 0;
+
+    return packer;
+}
+
+// value must not have bits set above num_bits
+static BITBUF_INLINE void
+bitbuf__pack(bitbuf__packer_t* packer, int num_bits, uint64_t value)
+{
+    packer->accum |= value << packer->accum_bits;
+    packer->accum_bits += num_bits;
+
+    if (packer->accum_bits >= BITBUF__SEG_BITS) {
+        *packer->seg++ = packer->accum;
+        packer->accum_bits -= BITBUF__SEG_BITS;
+
+        // shift by the 1..64 bits that fit, split to avoid shifting by 64
+        packer->accum = (value >> 1) >> (num_bits - packer->accum_bits - 1);
+    }
+}
+
+static BITBUF_INLINE void
+bitbuf__packer_end(bitbuf__packer_t* packer, bitbuf_buffer_t* buffer)
+{
+    if (bitbuf__write_in_partial_seg(buffer))
+        return;
+
+    if (packer->accum_bits)
+        *packer->seg = packer->accum;
+
+    buffer->write.seg = packer->seg;
+    buffer->write.bits_into_seg = packer->accum_bits;
+}
+
+// unchecked bit unpacker for bulk reads.  The bits must already be
+// known to be in the buffer, and at least one bit must be read.
+typedef struct {
+    const uint64_t* seg;
+    const uint8_t*  end;
+    uint64_t        cur;
+    int             cur_bits;
+} bitbuf__unpacker_t;
+
+static BITBUF_INLINE bitbuf__unpacker_t
+bitbuf__unpacker_begin(const bitbuf_cursor_t* cursor)
+{
+    bitbuf__unpacker_t unpacker;
+
+    unpacker.seg = cursor->seg;
+    unpacker.end = bitbuf__buffer_end(cursor->owner);
+    unpacker.cur = bitbuf__load_seg(cursor->seg, unpacker.end) >> cursor->bits_into_seg;
+    unpacker.cur_bits = BITBUF__SEG_BITS - cursor->bits_into_seg;
+
+    return unpacker;
+}
+
+static BITBUF_INLINE uint64_t
+bitbuf__unpack(bitbuf__unpacker_t* unpacker, int num_bits)
+{
+    uint64_t value;
+
+    if (num_bits <= unpacker->cur_bits) {
+        value = unpacker->cur & bitbuf__low_mask(num_bits);
+        unpacker->cur = num_bits < 64 ? unpacker->cur >> num_bits : 0;
+        unpacker->cur_bits -= num_bits;
+    } else {
+        uint64_t next = bitbuf__load_seg(++unpacker->seg, unpacker->end);
+        int      high_bits = num_bits - unpacker->cur_bits;
+
+        value = unpacker->cur | ((next & bitbuf__low_mask(high_bits)) << unpacker->cur_bits);
+        unpacker->cur = high_bits < 64 ? next >> high_bits : 0;
+        unpacker->cur_bits = BITBUF__SEG_BITS - high_bits;
+    }
+
+    return value;
+}
+
+static BITBUF_INLINE void
+bitbuf__unpacker_end(const bitbuf__unpacker_t* unpacker, bitbuf_cursor_t* cursor)
+{
+    cursor->seg = (uint64_t*)unpacker->seg;
+    cursor->bits_into_seg = BITBUF__SEG_BITS - unpacker->cur_bits;
+
+    if (cursor->bits_into_seg == BITBUF__SEG_BITS)
+        bitbuf__advance_cursor(cursor);
+}
+
 BITBUFDEF void
 bitbuf__write_bits(bitbuf_buffer_t* buffer, uint64_t datum, int num_bits)
 {
@@ -550,79 +2069,162 @@ bitbuf__write_bits(bitbuf_buffer_t* buffer, uint64_t datum, int num_bits)
     // occurred and a subsequent write was attempted.
     BITBUF__ASSERT_NO_WRITE_AFTER_READS(buffer);
 
-    if (bitbuf__remaining_capacity_in_bits(buffer) < num_bits) {
-        BITBUF__ASSERT_FAIL("out of space writing bits");
-        buffer->truncated |= 1;
+    if (num_bits == 0)
         return;
-    }
 
+    if (bitbuf__remaining_capacity_in_bits(buffer) < num_bits) {
+        if (!bitbuf__reserve_slow(buffer, num_bits))
+            return;
+    }
 
-    int bits_remaining_in_seg = BITBUF__SEG_BITS - buffer->write.bits_into_seg;
+    const int      bits_into_seg = buffer->write.bits_into_seg;
+    const uint64_t bits = datum & bitbuf__spanmasktable[num_bits];
 
-    // do the bits fit in the current seg?
-    if (num_bits <= bits_remaining_in_seg) {
-        const uint64_t SRC_MASK = bitbuf__spanmasktable[num_bits];
-        *buffer->write.seg |= (datum & SRC_MASK) << buffer->write.bits_into_seg;
+    *buffer->write.seg |= bits << bits_into_seg;
 
+    if (bits_into_seg + num_bits < BITBUF__SEG_BITS) {
         buffer->write.bits_into_seg += num_bits;
+        return;
+    }
 
-        if (buffer->write.bits_into_seg == BITBUF__SEG_BITS) {
-            bitbuf__advance_cursor(&buffer->write);
-
-            BITBUF__ASSERT(bitbuf__remaining_capacity_in_bits(buffer) >= 0);
-        }
-    } else {
-        // no - write the bits for the current segment and call recursively
-        // to do the remainder
-        const uint64_t SRC_MASK = bitbuf__spanmasktable[bits_remaining_in_seg];
-        *buffer->write.seg |= (datum & SRC_MASK)
-                              << (BITBUF__SEG_BITS - bits_remaining_in_seg);
-
-        bitbuf__advance_cursor(&buffer->write);
+    // the segment is full -- spill any bits that did not fit into the
+    // next one
+    bitbuf__advance_cursor(&buffer->write);
+    buffer->write.bits_into_seg = bits_into_seg + num_bits - BITBUF__SEG_BITS;
 
-        int num_bits_remaining_for_next_write = num_bits - bits_remaining_in_seg;
-        BITBUF__ASSERT(num_bits_remaining_for_next_write < BITBUF__SEG_BITS);
-        const uint64_t OVER_MASK =
-            bitbuf__spanmasktable[num_bits_remaining_for_next_write]
-            << (bits_remaining_in_seg);
-        bitbuf__write_bits(buffer,
-                           (datum & OVER_MASK) >> bits_remaining_in_seg,
-                           num_bits_remaining_for_next_write);
+    if (buffer->write.bits_into_seg != 0) {
+        *buffer->write.seg |= bits >> (BITBUF__SEG_BITS - bits_into_seg);
     }
 }
 
-// read up to 64 bits into *out_bits
-BITBUFDEF uint64_t
-bitbuf__read_bits(bitbuf_cursor_t* read, int num_bits)
+BITBUFDEF bitbuf_writer_t
+bitbuf_writer_begin(bitbuf_buffer_t* buf)
 {
-    const bitbuf_buffer_t* buffer = read->owner;
+    bitbuf_writer_t writer;
 
-    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
-    BITBUF__ASSERT(read->seg);
+    BITBUF__ASSERT_NO_WRITE_AFTER_READS(buf);
 
-    BITBUF__ASSERT(num_bits <= 64);
-    if (num_bits > 64) {
-        return 0;
-    }
+    writer.seg = buf->write.seg;
+    writer.end = buf->data + buf->capacity_bytes / sizeof(uint64_t);
+    writer.owner = buf;
 
-    if (bitbuf__bits_remaining_for_cursor(buffer, read) < num_bits) {
-        BITBUF__ASSERT_FAIL("read past end of buffer");
-        read->read_past_end |= 1;
-        return 0;
-    }
+    // the partially written segment becomes the accumulator.  a full
+    // buffer's partial final segment is not loaded; writes truncate.
+    writer.accum_bits = buf->write.bits_into_seg;
+    writer.accum =
+        writer.accum_bits && !bitbuf__write_in_partial_seg(buf) ? *writer.seg : 0;
 
-    int bits_remaining_in_seg = BITBUF__SEG_BITS - read->bits_into_seg;
+    return writer;
+}
 
-    // are there enough bits in the current seg?
-    if (num_bits <= bits_remaining_in_seg) {
-        const uint64_t DST_MASK = bitbuf__spanmasktable[num_bits] << read->bits_into_seg;
+BITBUFDEF void
+bitbuf__writer_flush_slow(bitbuf_writer_t* writer)
+{
+    bitbuf_buffer_t* buf = writer->owner;
 
-        uint64_t val = (*read->seg & DST_MASK) >> read->bits_into_seg;
+    // the write cursor of a full buffer with a partial final segment
+    // stays at its end
+    if (bitbuf__write_in_partial_seg(buf)) {
+        bitbuf__reserve_slow(buf, BITBUF__SEG_BITS);
+        return;
+    }
 
-        read->bits_into_seg += num_bits;
+    buf->write.seg = writer->seg;
+    buf->write.bits_into_seg = 0;
 
-        if (read->bits_into_seg == BITBUF__SEG_BITS) {
-            bitbuf__advance_cursor(read);
+    if (!bitbuf__reserve_slow(buf, BITBUF__SEG_BITS))
+        return;
+
+    // storage may have moved
+    writer->seg = buf->write.seg;
+    writer->end = buf->data + buf->capacity_bytes / sizeof(uint64_t);
+
+    *writer->seg++ = writer->accum;
+}
+
+BITBUFDEF void
+bitbuf_writer_end(bitbuf_writer_t* writer)
+{
+    bitbuf_buffer_t* buf = writer->owner;
+
+    // as in bitbuf__writer_flush_slow.  any bits written truncate.
+    if (bitbuf__write_in_partial_seg(buf)) {
+        if (writer->accum_bits != buf->write.bits_into_seg)
+            bitbuf__reserve_slow(buf, writer->accum_bits);
+        return;
+    }
+
+    buf->write.seg = writer->seg;
+    buf->write.bits_into_seg = 0;
+
+    if (writer->accum_bits == 0)
+        return;
+
+    if (writer->seg == writer->end &&
+        !bitbuf__reserve_slow(buf, writer->accum_bits))
+        return;
+
+    *buf->write.seg = writer->accum;
+    buf->write.bits_into_seg = writer->accum_bits;
+}
+
+// bitbuf__read_bits for reads from the final two segments of a buffer,
+// which are loaded without reading past its end.  the bits must be known
+// to be in the buffer.
+static BITBUF__NOINLINE uint64_t
+bitbuf__read_tail_bits(bitbuf_cursor_t* read, int num_bits)
+{
+    bitbuf__unpacker_t unpacker = bitbuf__unpacker_begin(read);
+    uint64_t           value = bitbuf__unpack(&unpacker, num_bits);
+
+    bitbuf__unpacker_end(&unpacker, read);
+
+    return value;
+}
+
+// read up to 64 bits into *out_bits
+BITBUFDEF uint64_t
+bitbuf__read_bits(bitbuf_cursor_t* read, int num_bits)
+{
+    const bitbuf_buffer_t* buffer = read->owner;
+
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+    BITBUF__ASSERT(read->seg);
+
+    BITBUF__ASSERT(num_bits <= 64);
+    if (num_bits > 64) {
+        return 0;
+    }
+
+    const ptrdiff_t REMAINING = bitbuf__bits_remaining_for_cursor(buffer, read);
+
+    if (REMAINING < num_bits) {
+        BITBUF__ASSERT_FAIL("read past end of buffer");
+        read->read_past_end |= 1;
+        return 0;
+    }
+
+    int bits_remaining_in_seg = BITBUF__SEG_BITS - read->bits_into_seg;
+
+    // near the end, the next segment may be missing or partial
+    if (REMAINING < bits_remaining_in_seg + BITBUF__SEG_BITS)
+        return bitbuf__read_tail_bits(read, num_bits);
+
+    uint64_t cur, next = 0;
+    memcpy(&cur, read->seg, sizeof(uint64_t));
+    if (num_bits > bits_remaining_in_seg)
+        memcpy(&next, read->seg + 1, sizeof(uint64_t));
+
+    // are there enough bits in the current seg?
+    if (num_bits <= bits_remaining_in_seg) {
+        const uint64_t DST_MASK = bitbuf__spanmasktable[num_bits] << read->bits_into_seg;
+
+        uint64_t val = (cur & DST_MASK) >> read->bits_into_seg;
+
+        read->bits_into_seg += num_bits;
+
+        if (read->bits_into_seg == BITBUF__SEG_BITS) {
+            bitbuf__advance_cursor(read);
         }
 
         return val;
@@ -632,23 +2234,130 @@ bitbuf__read_bits(bitbuf_cursor_t* read, int num_bits)
         const uint64_t DST_MASK = bitbuf__spanmasktable[bits_remaining_in_seg]
                                   << (BITBUF__SEG_BITS - bits_remaining_in_seg);
 
-        uint64_t val =
-            (*read->seg & DST_MASK) >> (BITBUF__SEG_BITS - bits_remaining_in_seg);
+        uint64_t val = (cur & DST_MASK) >> (BITBUF__SEG_BITS - bits_remaining_in_seg);
 
         bitbuf__advance_cursor(read);
         int next_read_num_bits = num_bits - bits_remaining_in_seg;
         BITBUF__ASSERT(next_read_num_bits < BITBUF__SEG_BITS);
-        BITBUF__ASSERT(bitbuf__bits_remaining_for_cursor(buffer, read) >= num_bits);
+        BITBUF__ASSERT(bitbuf__bits_remaining_for_cursor(buffer, read) >= next_read_num_bits);
 
         uint64_t OVER_MASK = bitbuf__spanmasktable[next_read_num_bits];
 
-        val |= (*read->seg & OVER_MASK) << bits_remaining_in_seg;
+        val |= (next & OVER_MASK) << bits_remaining_in_seg;
         read->bits_into_seg += next_read_num_bits;
 
         return val;
     }
 }
 
+// load a segment for a reader.  only the final segment can be partial,
+// and segments past the end load as zero.
+static BITBUF_INLINE uint64_t
+bitbuf__reader_load(const bitbuf_reader_t* reader, size_t seg)
+{
+    uint64_t value;
+
+    if (seg + 1 >= reader->num_segs)
+        return seg + 1 == reader->num_segs ? reader->last : 0;
+
+    memcpy(&value, reader->owner->data + seg, sizeof(uint64_t));
+    return value;
+}
+
+BITBUFDEF bitbuf_reader_t
+bitbuf_reader_init_at(const bitbuf_cursor_t* cursor)
+{
+    bitbuf_reader_t reader;
+    size_t          seg;
+
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(cursor));
+
+    reader.owner = cursor->owner;
+    reader.num_segs = (cursor->owner->capacity_bytes + 7) / sizeof(uint64_t);
+    reader.last = reader.num_segs ? bitbuf__load_seg(reader.owner->data + reader.num_segs - 1,
+                                                     bitbuf__buffer_end(reader.owner))
+                                  : 0;
+    reader.read_past_end = cursor->read_past_end;
+
+    seg = cursor->seg - cursor->owner->data;
+    if (seg < reader.num_segs) {
+        reader.cur = bitbuf__reader_load(&reader, seg) >> cursor->bits_into_seg;
+        reader.cur_bits = BITBUF__SEG_BITS - cursor->bits_into_seg;
+        reader.next_seg = seg + 1;
+    } else {
+        reader.cur = 0;
+        reader.cur_bits = 0;
+        reader.next_seg = seg;
+    }
+
+    reader.next = bitbuf__reader_load(&reader, reader.next_seg);
+
+    return reader;
+}
+
+BITBUFDEF bitbuf_reader_t
+bitbuf_reader_init(bitbuf_buffer_t* buffer)
+{
+    bitbuf_cursor_t cursor = bitbuf_cursor_init(buffer);
+
+    return bitbuf_reader_init_at(&cursor);
+}
+
+BITBUFDEF bitbuf_cursor_t
+bitbuf_reader_get_cursor(const bitbuf_reader_t* reader)
+{
+    bitbuf_cursor_t cursor;
+    size_t          bit_pos = reader->next_seg * BITBUF__SEG_BITS - reader->cur_bits;
+
+    cursor.seg = (uint64_t*)reader->owner->data + bit_pos / BITBUF__SEG_BITS;
+    cursor.bits_into_seg = (int)(bit_pos % BITBUF__SEG_BITS);
+    cursor.owner = reader->owner;
+    cursor.read_past_end = reader->read_past_end;
+
+    return cursor;
+}
+
+BITBUFDEF void
+bitbuf_reader_skip_byte_padding(bitbuf_reader_t* reader)
+{
+    int pad_bits = reader->cur_bits & 7;
+
+    reader->cur >>= pad_bits;
+    reader->cur_bits -= pad_bits;
+}
+
+BITBUFDEF uint64_t
+bitbuf__reader_read_slow(bitbuf_reader_t* reader, int num_bits)
+{
+    BITBUF__ASSERT(num_bits <= 64);
+    if (num_bits > 64) {
+        return 0;
+    }
+
+    if (reader->next_seg >= reader->num_segs) {
+        BITBUF__ASSERT_FAIL("read past end of buffer");
+        reader->read_past_end |= 1;
+        return 0;
+    }
+
+    // the remaining bits in cur are the low part of the value
+    uint64_t low = reader->cur;
+    int      low_bits = reader->cur_bits;
+    int      high_bits = num_bits - low_bits;
+
+    reader->cur = reader->next;
+    reader->cur_bits = BITBUF__SEG_BITS;
+    reader->next_seg++;
+    reader->next = bitbuf__reader_load(reader, reader->next_seg);
+
+    uint64_t value = low | ((reader->cur & bitbuf__low_mask(high_bits)) << low_bits);
+
+    reader->cur = high_bits < 64 ? reader->cur >> high_bits : 0;
+    reader->cur_bits -= high_bits;
+
+    return value;
+}
+
 BITBUF__DECL_WRITE_T(int64);
 BITBUF__DECL_WRITE_T(int32);
 BITBUF__DECL_WRITE_T(int16);
@@ -671,17 +2380,8 @@ bitbuf_write_bool(bitbuf_buffer_t* buf, bool value)
 BITBUFDEF void
 bitbuf_write_cstr(bitbuf_buffer_t* buf, const char* str)
 {
-    const char* p = str;
-
-    while (*p) {
-        // perf: write n bits to align, then power through 64-bits at a time
-        // until the last 64 bits
-        bitbuf__write_bits(buf, *p, 8);
-        p++;
-    }
-
-    // write null terminator
-    bitbuf__write_bits(buf, 0, 8);
+    // include null terminator
+    bitbuf_write_bytes(buf, str, strlen(str) + 1);
 }
 
 BITBUFDEF void
@@ -700,6 +2400,25 @@ bitbuf_write_n_bits(bitbuf_buffer_t* buf, int num_bits, uint64_t value)
 
 
 
+// shared by all float quantizers so that they round and saturate
+// identically
+static BITBUF_INLINE uint64_t
+bitbuf__quantize_float(float value, float min, float range, uint32_t bit_max)
+{
+    float qf = BITBUF__MIN(BITBUF__MAX(((value - min) * bit_max) / range, 0), bit_max);
+    uint64_t qi = (uint64_t)qf;
+
+    // expr '(value - min) * mult' performed as floating point may result in one additional
+    // bit, causing qi to exceed num_bits and failing to represent saturation.
+    return qi && (qi & bit_max) == 0 ? bit_max : qi;
+}
+
+static BITBUF_INLINE float
+bitbuf__dequantize_float(uint64_t value, float min, float range, uint32_t bit_max)
+{
+    return min + (((float)value / bit_max) * range);
+}
+
 BITBUFDEF void
 bitbuf_write_quantized_float(bitbuf_buffer_t* buf, int num_bits, float min, float max, float value)
 {
@@ -709,22 +2428,14 @@ bitbuf_write_quantized_float(bitbuf_buffer_t* buf, int num_bits, float min, floa
 
     const uint32_t bit_max = (uint32_t)bitbuf__spanmasktable[num_bits];
 
-    float qf =
-        BITBUF__MIN(BITBUF__MAX(((value - min) * bit_max) / (max - min), 0), bit_max);
-    uint64_t qi = (uint64_t)qf;
-
-    // expr '(value - min) * mult' performed as floating point may result in one additional
-    // bit, causing qi to exceed num_bits and failing to represent saturation.
-    qi = qi && (qi & bit_max) == 0 ? bit_max : qi;
-
-    bitbuf__write_bits(buf, qi, num_bits);
+    bitbuf__write_bits(buf, bitbuf__quantize_float(value, min, max - min, bit_max), num_bits);
 }
 
 
 BITBUFDEF void
 bitbuf_pad_to_byte(bitbuf_buffer_t* buf)
 {
-    int align_bits = BITBUF__ALIGN_UP_DELTA(buf->write.bits_into_seg, 8);
+    int align_bits = BITBUF__ALIGN_UP_DELTA((int)(bitbuf_num_bits_written(buf) % 8), 8);
     if (align_bits != 0) {
         uint64_t zero = 0;
 
@@ -732,6 +2443,58 @@ bitbuf_pad_to_byte(bitbuf_buffer_t* buf)
     }
 }
 
+BITBUFDEF bitbuf_checkpoint_t
+bitbuf_checkpoint(bitbuf_buffer_t* buf)
+{
+    bitbuf_checkpoint_t checkpoint;
+
+    BITBUF__ASSERT_NO_WRITE_AFTER_READS(buf);
+
+    checkpoint.bit_pos = bitbuf_num_bits_written(buf);
+    checkpoint.truncated = buf->truncated;
+    buf->open_checkpoints++;
+
+    return checkpoint;
+}
+
+BITBUFDEF void
+bitbuf_rollback(bitbuf_buffer_t* buf, const bitbuf_checkpoint_t* checkpoint)
+{
+    const size_t END_POS = bitbuf_num_bits_written(buf);
+
+    BITBUF__ASSERT_NO_WRITE_AFTER_READS(buf);
+    BITBUF__ASSERT(buf->open_checkpoints > 0);
+    BITBUF__ASSERT(checkpoint->bit_pos <= END_POS);
+
+    if (buf->measuring) {
+        buf->measured_bits = checkpoint->bit_pos;
+    } else if (END_POS > checkpoint->bit_pos) {
+        // writes OR into zeroed memory, so clear what is being discarded
+        const size_t END_SEG = (END_POS - 1) / BITBUF__SEG_BITS;
+
+        bitbuf__set_cursor_pos(&buf->write, buf->data, checkpoint->bit_pos);
+        *buf->write.seg &= bitbuf__low_mask(buf->write.bits_into_seg);
+
+        uint64_t* first_clear = buf->write.seg + 1;
+        uint64_t* end = buf->data + END_SEG + 1;
+        if (end > first_clear)
+            memset(first_clear, 0, (size_t)(end - first_clear) * sizeof(uint64_t));
+    }
+
+    buf->truncated = checkpoint->truncated;
+    buf->open_checkpoints--;
+}
+
+BITBUFDEF void
+bitbuf_commit(bitbuf_buffer_t* buf, const bitbuf_checkpoint_t* checkpoint)
+{
+    BITBUF__ASSERT(buf->open_checkpoints > 0);
+    BITBUF__ASSERT(checkpoint->bit_pos <= bitbuf_num_bits_written(buf));
+    (void)checkpoint;
+
+    buf->open_checkpoints--;
+}
+
 BITBUF__DECL_READ_T(int64);
 BITBUF__DECL_READ_T(int32);
 BITBUF__DECL_READ_T(int16);
@@ -753,14 +2516,67 @@ bitbuf_read_bool(bitbuf_cursor_t* read)
 BITBUFDEF void
 bitbuf_read_cstr(bitbuf_cursor_t* read, size_t max_bytes, char* out_str)
 {
-    size_t i;
-    for (i = 0; i < max_bytes; i++) {
-        out_str[i] = (char)bitbuf__read_bits(read, 8);
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+
+    size_t avail_bytes = bitbuf__bits_remaining_for_cursor(read->owner, read) / 8;
+    size_t scan_bytes = BITBUF__MIN(max_bytes, avail_bytes);
+    size_t i = 0;
+
+    if (BITBUF__LITTLE_ENDIAN && (read->bits_into_seg & 7) == 0) {
+        size_t         pos = bitbuf__cursor_pos(read, read->owner->data);
+        const uint8_t* src = (const uint8_t*)read->owner->data + pos / 8;
+        const uint8_t* nul = (const uint8_t*)memchr(src, 0, scan_bytes);
+
+        if (nul) {
+            size_t len = nul - src + 1;
+            memcpy(out_str, src, len);
+            bitbuf__set_cursor_pos(read, read->owner->data, pos + len * 8);
+            return;
+        }
+
+        memcpy(out_str, src, scan_bytes);
+        bitbuf__set_cursor_pos(read, read->owner->data, pos + scan_bytes * 8);
+        i = scan_bytes;
+    } else if (scan_bytes > 0) {
+        bitbuf__unpacker_t unpacker = bitbuf__unpacker_begin(read);
+        bool               found = false;
+
+        // a word at a time, until a word contains a zero byte
+        for (; i + 8 <= scan_bytes; i += 8) {
+            bitbuf__unpacker_t word_start = unpacker;
+            uint64_t           word = bitbuf__unpack(&unpacker, 64);
+
+            if (((word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull) != 0) {
+                // the word holds the terminator -- finish bytewise
+                unpacker = word_start;
+                break;
+            }
+
+            bitbuf__store_le64((uint8_t*)out_str + i, word);
+        }
 
-        if (out_str[i] == '\0')
+        for (; i < scan_bytes; i++) {
+            out_str[i] = (char)bitbuf__unpack(&unpacker, 8);
+            if (out_str[i] == '\0') {
+                found = true;
+                i++;
+                break;
+            }
+        }
+
+        bitbuf__unpacker_end(&unpacker, read);
+        if (found)
             return;
     }
 
+    if (max_bytes > avail_bytes) {
+        // the string runs off the end of the buffer
+        BITBUF__ASSERT_FAIL("read past end of buffer");
+        read->read_past_end |= 1;
+        out_str[i] = '\0';
+        return;
+    }
+
     // null terminator not found -- terminate string
     out_str[0] = '\0';
 }
@@ -809,162 +2625,4814 @@ bitbuf_read_quantized_float(bitbuf_cursor_t* read, int num_bits, float min, floa
     uint64_t       value = bitbuf_read_n_bits(read, num_bits, NULL);
     const uint32_t bit_max = (uint32_t)bitbuf__spanmasktable[num_bits];
 
-    float q = min + (((float)value / bit_max) * (max - min));
+    float q = bitbuf__dequantize_float(value, min, max - min, bit_max);
     BITBUF__ASSERT(q >= min && q <= max);
 
     return q;
 }
 
-// tests follow -- this is intended to be ran by a core developer
-// who includes ftg_test.h, a test harness.
-#ifdef FTGT_TESTS_ENABLED
+BITBUFDEF uint64_t
+bitbuf_peek_n_bits(const bitbuf_cursor_t* read, int num_bits)
+{
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+    BITBUF__ASSERT(num_bits <= 64);
 
-struct bitbuf_testvars_s {
-    bitbuf_buffer_t buf;
-};
+    ptrdiff_t remaining = bitbuf__bits_remaining_for_cursor(read->owner, read);
 
-static struct bitbuf_testvars_s bitbuf__tv;
+    if (remaining <= 0 || num_bits <= 0)
+        return 0;
 
-static int
-bitbuf__test_setup(void)
+    bitbuf__unpacker_t unpacker = bitbuf__unpacker_begin(read);
+    return bitbuf__unpack(&unpacker, (int)BITBUF__MIN(num_bits, remaining));
+}
+
+BITBUFDEF size_t
+bitbuf_cursor_tell_bits(const bitbuf_cursor_t* read)
 {
-    bitbuf__tv.buf = bitbuf_alloc_buffer(256);
-    return 0; /* setup success */
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+
+    return bitbuf__cursor_pos(read, read->owner->data);
 }
 
-static int
-bitbuf__test_teardown(void)
+BITBUFDEF void
+bitbuf_cursor_seek_bits(bitbuf_cursor_t* read, size_t bit_pos)
 {
-    bitbuf_free_buffer(&bitbuf__tv.buf);
-    return 0;
+    BITBUF__ASSERT(read && read->owner);
+
+    if (bit_pos > read->owner->capacity_bytes * 8) {
+        BITBUF__ASSERT_FAIL("seek past end of buffer");
+        read->read_past_end |= 1;
+        return;
+    }
+
+    bitbuf__set_cursor_pos(read, read->owner->data, bit_pos);
 }
 
-static int
-bitbuf__test_basic(void)
+// returns true if total_bits can be written, growing the buffer if
+// needed.  Write routines that check capacity once for a run of
+// fields call this up front.
+static bool
+bitbuf__reserve(bitbuf_buffer_t* buffer, size_t total_bits)
 {
-    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+    // if this is hit, a call to bitbuf_init_cursor() (to begin reading) has
+    // occurred and a subsequent write was attempted.
+    BITBUF__ASSERT_NO_WRITE_AFTER_READS(buffer);
 
-    // writes
-    bitbuf_write_bool(buf, true);
-    bitbuf_pad_to_byte(buf);
-    bitbuf_write_int64(buf, -32);
-    bitbuf_write_cstr(buf, "hello, world");
-    bitbuf_write_float(buf, -325.32f);
-    bitbuf_write_n_bits(buf, 4, 13);
-    bitbuf_pad_to_byte(buf);
-    bitbuf_write_n_bits(buf, 7, 121);
+    if ((size_t)bitbuf__remaining_capacity_in_bits(buffer) >= total_bits)
+        return true;
 
-    // reads
-    bitbuf_cursor_t read = bitbuf_cursor_init(buf);
+    return bitbuf__reserve_slow(buffer, total_bits);
+}
 
-    TEST(bitbuf_read_bool(&read) == true);
-    bitbuf_skip_byte_padding(&read);
-    TEST(bitbuf_read_int64(&read) == -32);
+// reads of a block of fields check read_past_end after their parts.
+// as the flag may be left set by an earlier read, it is cleared for the
+// block, so only the block's own failures are seen, and the earlier
+// state is restored after it.
+static BITBUF_INLINE int
+bitbuf__begin_block_read(bitbuf_cursor_t* read)
+{
+    int past_end = read->read_past_end;
 
-    char            str[256];
-    bitbuf_cursor_t read2 = read;
-    bitbuf_read_cstr(&read, 256, str);
-    TEST(strcmp(str, "hello, world") == 0);
+    read->read_past_end = 0;
+    return past_end;
+}
 
-    // no room for null terminator
-    bitbuf_read_cstr(&read2, strlen("hello, world"), str);
-    TEST(str[0] == '\0');
+static BITBUF_INLINE void
+bitbuf__end_block_read(bitbuf_cursor_t* read, int past_end)
+{
+    read->read_past_end |= past_end;
+}
 
-    TEST(bitbuf_read_float(&read) == -325.32f);
+// returns true if total_bits can be read from the cursor.  On failure
+// read_past_end is set.
+static bool
+bitbuf__can_read(bitbuf_cursor_t* read, size_t total_bits)
+{
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
 
-    uint64_t mask;
-    TEST(bitbuf_read_n_bits(&read, 4, &mask) == 13);
-    TEST(mask == 15);
+    if ((size_t)bitbuf__bits_remaining_for_cursor(read->owner, read) >= total_bits)
+        return true;
 
-    bitbuf_skip_byte_padding(&read);
+    BITBUF__ASSERT_FAIL("read past end of buffer");
+    read->read_past_end |= 1;
 
-    TEST(bitbuf_read_n_bits(&read, 7, NULL) == 121);
+    return false;
+}
 
-    return ftgt_test_errorlevel();
+// full width values at a byte aligned position are already in stream
+// order on little endian targets.  returns true if values were copied.
+static bool
+bitbuf__copy_array_to_buffer(bitbuf_buffer_t* buf,
+                             int              num_bits,
+                             const void*      values,
+                             size_t           count,
+                             size_t           value_size)
+{
+    if (!BITBUF__LITTLE_ENDIAN || (buf->write.bits_into_seg & 7) != 0 ||
+        (size_t)num_bits != value_size * 8)
+        return false;
+
+    size_t pos = bitbuf__cursor_pos(&buf->write, buf->data);
+    memcpy((uint8_t*)buf->data + pos / 8, values, count * value_size);
+    bitbuf__set_cursor_pos(&buf->write, buf->data, pos + count * num_bits);
+
+    return true;
 }
 
-static int
-bitbuf__test_buffer_overflow(void)
+static bool
+bitbuf__copy_array_from_cursor(bitbuf_cursor_t* read,
+                               int              num_bits,
+                               void*            out_values,
+                               size_t           count,
+                               size_t           value_size)
 {
-    // write non-overflow -- cursor aligns to end of only segment, but
-    // does not overflow
-    {
-        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
-        bitbuf_write_uint64(&buf, 0xFF);
-        TEST(!bitbuf_has_truncated(&buf));
-        bitbuf_free_buffer(&buf);
-    }
+    if (!BITBUF__LITTLE_ENDIAN || (read->bits_into_seg & 7) != 0 ||
+        (size_t)num_bits != value_size * 8)
+        return false;
 
-    // write overflow on non-aligned write
-    {
-        // this allocates 64 bits because bitbuffer rounds up to segment width.
-        // we then write 65 bits, and expect a truncation.
-        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
-        bitbuf_write_bool(&buf, true);
-        bitbuf_write_uint64(&buf, 0xFF);
+    size_t pos = bitbuf__cursor_pos(read, read->owner->data);
+    memcpy(out_values, (const uint8_t*)read->owner->data + pos / 8, count * value_size);
+    bitbuf__set_cursor_pos(read, read->owner->data, pos + count * num_bits);
 
-        // expect an assert to be triggered in previous bitbuf call
-        TEST(ftgt_test_errorlevel());
+    return true;
+}
 
-        TEST(bitbuf_has_truncated(&buf));
+#define BITBUF__DECL_ARRAY(in_type)                                            \
+    BITBUFDEF void bitbuf_write_n_bits_array_##in_type(                        \
+        bitbuf_buffer_t* buf, int num_bits, const in_type##_t* vals, size_t n) \
+    {                                                                          \
+        const uint64_t   MASK = bitbuf__low_mask(num_bits);                    \
+        const size_t     SIZE = sizeof(in_type##_t);                           \
+        bitbuf__packer_t packer;                                               \
+        size_t           i;                                                    \
+                                                                               \
+        BITBUF__ASSERT(num_bits > 0 && (size_t)num_bits <= SIZE * 8);          \
+        if (n == 0 || !bitbuf__reserve(buf, (size_t)num_bits * n))             \
+            return;                                                            \
+        if (bitbuf__copy_array_to_buffer(buf, num_bits, vals, n, SIZE))        \
+            return;                                                            \
+                                                                               \
+        packer = bitbuf__packer_begin(buf);                                    \
+        for (i = 0; i + 4 <= n; i += 4) {                                      \
+            bitbuf__pack(&packer, num_bits, vals[i + 0] & MASK);               \
+            bitbuf__pack(&packer, num_bits, vals[i + 1] & MASK);               \
+            bitbuf__pack(&packer, num_bits, vals[i + 2] & MASK);               \
+            bitbuf__pack(&packer, num_bits, vals[i + 3] & MASK);               \
+        }                                                                      \
+        for (; i < n; i++) {                                                   \
+            bitbuf__pack(&packer, num_bits, vals[i] & MASK);                   \
+        }                                                                      \
+        bitbuf__packer_end(&packer, buf);                                      \
+    }                                                                          \
+                                                                               \
+    BITBUFDEF void bitbuf_write_##in_type##_array(                             \
+        bitbuf_buffer_t* buf, const in_type##_t* vals, size_t count)           \
+    {                                                                          \
+        bitbuf_write_n_bits_array_##in_type(                                   \
+            buf, sizeof(in_type##_t) * 8, vals, count);                        \
+    }                                                                          \
+                                                                               \
+    BITBUFDEF void bitbuf_read_n_bits_array_##in_type(                         \
+        bitbuf_cursor_t* read, int num_bits, in_type##_t* out, size_t count)   \
+    {                                                                          \
+        const size_t       SIZE = sizeof(in_type##_t);                         \
+        bitbuf__unpacker_t unpacker;                                           \
+        size_t             i;                                                  \
+                                                                               \
+        BITBUF__ASSERT(num_bits > 0 && (size_t)num_bits <= SIZE * 8);          \
+        if (count == 0)                                                        \
+            return;                                                            \
+        if (!bitbuf__can_read(read, (size_t)num_bits * count)) {               \
+            memset(out, 0, count * SIZE);                                      \
+            return;                                                            \
+        }                                                                      \
+        if (bitbuf__copy_array_from_cursor(read, num_bits, out, count, SIZE))  \
+            return;                                                            \
+                                                                               \
+        unpacker = bitbuf__unpacker_begin(read);                               \
+        for (i = 0; i + 4 <= count; i += 4) {                                  \
+            out[i + 0] = (in_type##_t)bitbuf__unpack(&unpacker, num_bits);     \
+            out[i + 1] = (in_type##_t)bitbuf__unpack(&unpacker, num_bits);     \
+            out[i + 2] = (in_type##_t)bitbuf__unpack(&unpacker, num_bits);     \
+            out[i + 3] = (in_type##_t)bitbuf__unpack(&unpacker, num_bits);     \
+        }                                                                      \
+        for (; i < count; i++) {                                               \
+            out[i] = (in_type##_t)bitbuf__unpack(&unpacker, num_bits);         \
+        }                                                                      \
+        bitbuf__unpacker_end(&unpacker, read);                                 \
+    }                                                                          \
+                                                                               \
+    BITBUFDEF void bitbuf_read_##in_type##_array(                              \
+        bitbuf_cursor_t* read, in_type##_t* out, size_t count)                 \
+    {                                                                          \
+        bitbuf_read_n_bits_array_##in_type(                                    \
+            read, sizeof(in_type##_t) * 8, out, count);                        \
+    }
+
+BITBUF__DECL_ARRAY(uint64)
+BITBUF__DECL_ARRAY(uint32)
+BITBUF__DECL_ARRAY(uint16)
+BITBUF__DECL_ARRAY(uint8)
+
+// values are quantized into a stack chunk, then bit packed
+#define BITBUF__QUANT_CHUNK 256
+
+// vector equivalents of bitbuf__quantize_float.  max/min select the
+// same operand as BITBUF__MAX/BITBUF__MIN for NaN and signed zero, and
+// truncating 2^31 (bit_max of 31 bits, rounded to float) produces
+// 0x80000000, so the results are bit exact.
+static void
+bitbuf__quantize_floats(
+    const float* values, size_t count, float min, float range, uint32_t bit_max, uint32_t* out)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256  MIN = _mm256_set1_ps(min);
+        const __m256  RANGE = _mm256_set1_ps(range);
+        const __m256  BIT_MAX_F = _mm256_set1_ps((float)bit_max);
+        const __m256i BIT_MAX = _mm256_set1_epi32((int)bit_max);
+        const __m256i ZERO = _mm256_setzero_si256();
+
+        for (; i + 8 <= count; i += 8) {
+            __m256 qf = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), MIN), BIT_MAX_F);
+            qf = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(qf, RANGE), _mm256_setzero_ps()),
+                               BIT_MAX_F);
+
+            __m256i qi = _mm256_cvttps_epi32(qf);
+
+            // saturation fix-up: non-zero with no bits inside bit_max
+            __m256i sat = _mm256_andnot_si256(
+                _mm256_cmpeq_epi32(qi, ZERO),
+                _mm256_cmpeq_epi32(_mm256_and_si256(qi, BIT_MAX), ZERO));
+            qi = _mm256_blendv_epi8(qi, BIT_MAX, sat);
+
+            _mm256_storeu_si256((__m256i*)(out + i), qi);
+        }
+    }
+#endif
+
+#if defined(BITBUF__SSE2)
+    {
+        const __m128  MIN = _mm_set1_ps(min);
+        const __m128  RANGE = _mm_set1_ps(range);
+        const __m128  BIT_MAX_F = _mm_set1_ps((float)bit_max);
+        const __m128i BIT_MAX = _mm_set1_epi32((int)bit_max);
+        const __m128i ZERO = _mm_setzero_si128();
+
+        for (; i + 4 <= count; i += 4) {
+            __m128 qf = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + i), MIN), BIT_MAX_F);
+            qf = _mm_min_ps(_mm_max_ps(_mm_div_ps(qf, RANGE), _mm_setzero_ps()), BIT_MAX_F);
+
+            __m128i qi = _mm_cvttps_epi32(qf);
+            __m128i sat = _mm_andnot_si128(_mm_cmpeq_epi32(qi, ZERO),
+                                           _mm_cmpeq_epi32(_mm_and_si128(qi, BIT_MAX), ZERO));
+            qi = _mm_or_si128(_mm_andnot_si128(sat, qi), _mm_and_si128(sat, BIT_MAX));
+
+            _mm_storeu_si128((__m128i*)(out + i), qi);
+        }
+    }
+#elif defined(BITBUF__NEON)
+    {
+        const float32x4_t MIN = vdupq_n_f32(min);
+        const float32x4_t RANGE = vdupq_n_f32(range);
+        const float32x4_t BIT_MAX_F = vdupq_n_f32((float)bit_max);
+        const uint32x4_t  BIT_MAX = vdupq_n_u32(bit_max);
+
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t qf = vmulq_f32(vsubq_f32(vld1q_f32(values + i), MIN), BIT_MAX_F);
+            qf = vminq_f32(vmaxq_f32(vdivq_f32(qf, RANGE), vdupq_n_f32(0.0f)), BIT_MAX_F);
+
+            // NaN propagates through vmaxq/vminq, but converts to 0 as in
+            // the scalar path
+            uint32x4_t qi = vcvtq_u32_f32(qf);
+            uint32x4_t sat = vandq_u32(vtstq_u32(qi, qi), vceqq_u32(vandq_u32(qi, BIT_MAX),
+                                                                     vdupq_n_u32(0)));
+            qi = vbslq_u32(sat, BIT_MAX, qi);
+
+            vst1q_u32(out + i, qi);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = (uint32_t)bitbuf__quantize_float(values[i], min, range, bit_max);
+    }
+}
+
+static void
+bitbuf__dequantize_floats(
+    const uint32_t* values, size_t count, float min, float range, uint32_t bit_max, float* out)
+{
+    size_t i = 0;
+
+#if defined(BITBUF__SSE2)
+    {
+        const __m128 MIN = _mm_set1_ps(min);
+        const __m128 RANGE = _mm_set1_ps(range);
+        const __m128 BIT_MAX_F = _mm_set1_ps((float)bit_max);
+
+        // values are at most 31 bits, so the signed conversion is exact
+        for (; i + 4 <= count; i += 4) {
+            __m128 q = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(values + i)));
+            _mm_storeu_ps(out + i, _mm_add_ps(MIN, _mm_mul_ps(_mm_div_ps(q, BIT_MAX_F), RANGE)));
+        }
+    }
+#elif defined(BITBUF__NEON)
+    {
+        const float32x4_t MIN = vdupq_n_f32(min);
+        const float32x4_t RANGE = vdupq_n_f32(range);
+        const float32x4_t BIT_MAX_F = vdupq_n_f32((float)bit_max);
+
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t q = vcvtq_f32_u32(vld1q_u32(values + i));
+            vst1q_f32(out + i, vaddq_f32(MIN, vmulq_f32(vdivq_f32(q, BIT_MAX_F), RANGE)));
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = bitbuf__dequantize_float(values[i], min, range, bit_max);
+    }
+}
+
+BITBUFDEF void
+bitbuf_write_quantized_float_array(bitbuf_buffer_t* buf,
+                                   int              num_bits,
+                                   float            min,
+                                   float            max,
+                                   const float*     values,
+                                   size_t           count)
+{
+    BITBUF__ASSERT(num_bits > 0 && num_bits <= 31);
+    BITBUF__ASSERT(min < max);
+
+    const uint32_t   BIT_MAX = (uint32_t)bitbuf__spanmasktable[num_bits];
+    uint32_t         chunk[BITBUF__QUANT_CHUNK];
+    bitbuf__packer_t packer;
+    size_t           i, j;
+
+    if (count == 0 || !bitbuf__reserve(buf, (size_t)num_bits * count))
+        return;
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < count; i += BITBUF__QUANT_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__QUANT_CHUNK);
+
+        for (j = 0; j < n; j++) {
+            BITBUF__ASSERT(values[i + j] >= min && values[i + j] <= max);
+        }
+
+        bitbuf__quantize_floats(values + i, n, min, max - min, BIT_MAX, chunk);
+        for (j = 0; j < n; j++) {
+            bitbuf__pack(&packer, num_bits, chunk[j]);
+        }
+    }
+    bitbuf__packer_end(&packer, buf);
+}
+
+BITBUFDEF void
+bitbuf_read_quantized_float_array(bitbuf_cursor_t* read,
+                                  int              num_bits,
+                                  float            min,
+                                  float            max,
+                                  float*           out_values,
+                                  size_t           count)
+{
+    BITBUF__ASSERT(num_bits > 0 && num_bits <= 31);
+    BITBUF__ASSERT(min < max);
+
+    const uint32_t     BIT_MAX = (uint32_t)bitbuf__spanmasktable[num_bits];
+    uint32_t           chunk[BITBUF__QUANT_CHUNK];
+    bitbuf__unpacker_t unpacker;
+    size_t             i, j;
+
+    if (count == 0)
+        return;
+    if (!bitbuf__can_read(read, (size_t)num_bits * count)) {
+        memset(out_values, 0, count * sizeof(float));
+        return;
+    }
+
+    unpacker = bitbuf__unpacker_begin(read);
+    for (i = 0; i < count; i += BITBUF__QUANT_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__QUANT_CHUNK);
+
+        for (j = 0; j < n; j++) {
+            chunk[j] = (uint32_t)bitbuf__unpack(&unpacker, num_bits);
+        }
+        bitbuf__dequantize_floats(chunk, n, min, max - min, BIT_MAX, out_values + i);
+    }
+    bitbuf__unpacker_end(&unpacker, read);
+}
+
+static BITBUF_INLINE uint32_t
+bitbuf__float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static BITBUF_INLINE float
+bitbuf__bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// float to binary16, rounding to nearest even.  integer only, so the
+// result does not depend on the floating point environment, and
+// matches the F16C and NEON conversions bit for bit.
+static uint16_t
+bitbuf__float_to_half(float value)
+{
+    const uint32_t BITS = bitbuf__float_bits(value);
+    const uint32_t SIGN = (BITS >> 16) & 0x8000;
+    const uint32_t ABS = BITS & 0x7fffffff;
+    uint32_t       half, rem;
+
+    // inf or NaN.  NaNs are quieted, keeping the top of the payload
+    if (ABS >= 0x7f800000)
+        return (uint16_t)(SIGN | 0x7c00 | (ABS > 0x7f800000 ? 0x200 | ((ABS >> 13) & 0x3ff) : 0));
+
+    // rounds to 65520 or more
+    if (ABS >= 0x477ff000)
+        return (uint16_t)(SIGN | 0x7c00);
+
+    // normal
+    if (ABS >= 0x38800000) {
+        half = (ABS - 0x38000000) >> 13;
+        rem = ABS & 0x1fff;
+        half += rem > 0x1000 || (rem == 0x1000 && (half & 1));
+
+        return (uint16_t)(SIGN | half);
+    }
+
+    // subnormal, or zero if below half of 2^-24
+    const uint32_t EXP = ABS >> 23;
+    if (EXP < 102)
+        return (uint16_t)SIGN;
+
+    const uint32_t MANT = (ABS & 0x7fffff) | 0x800000;
+    const int      SHIFT = 126 - (int)EXP;
+    const uint32_t HALFWAY = 1u << (SHIFT - 1);
+
+    half = MANT >> SHIFT;
+    rem = MANT & ((1u << SHIFT) - 1);
+    half += rem > HALFWAY || (rem == HALFWAY && (half & 1));
+
+    return (uint16_t)(SIGN | half);
+}
+
+static float
+bitbuf__half_to_float(uint16_t half)
+{
+    const uint32_t SIGN = (uint32_t)(half & 0x8000) << 16;
+    const uint32_t EXP = (half >> 10) & 0x1f;
+    uint32_t       mant = half & 0x3ff;
+
+    if (EXP == 0x1f)
+        return bitbuf__bits_float(SIGN | 0x7f800000 | (mant ? 0x400000 | (mant << 13) : 0));
+
+    if (EXP != 0)
+        return bitbuf__bits_float(SIGN | ((EXP + 112) << 23) | (mant << 13));
+
+    if (mant == 0)
+        return bitbuf__bits_float(SIGN);
+
+    // subnormal half, normal float
+    uint32_t exp = 113;
+    while ((mant & 0x400) == 0) {
+        mant <<= 1;
+        exp--;
+    }
+
+    return bitbuf__bits_float(SIGN | (exp << 23) | ((mant & 0x3ff) << 13));
+}
+
+// bfloat16 is the top half of a float.  converted in software on all
+// targets: the integer form vectorizes, and hardware bfloat16
+// conversions flush subnormals.
+static BITBUF_INLINE uint16_t
+bitbuf__float_to_bfloat16(float value)
+{
+    const uint32_t BITS = bitbuf__float_bits(value);
+
+    if ((BITS & 0x7fffffff) > 0x7f800000)
+        return (uint16_t)((BITS >> 16) | 0x40);
+
+    return (uint16_t)((BITS + 0x7fff + ((BITS >> 16) & 1)) >> 16);
+}
+
+static BITBUF_INLINE float
+bitbuf__bfloat16_to_float(uint16_t value)
+{
+    return bitbuf__bits_float((uint32_t)value << 16);
+}
+
+// values are converted into a stack chunk, then written as a uint16
+// array
+#define BITBUF__HALF_CHUNK 256
+
+static void
+bitbuf__floats_to_half(const float* values, size_t count, uint16_t* out)
+{
+    size_t i = 0;
+
+#if defined(BITBUF__F16C)
+    for (; i + 8 <= count; i += 8) {
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(out + i), half);
+    }
+#elif defined(BITBUF__NEON)
+    for (; i + 4 <= count; i += 4) {
+        vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(values + i))));
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = bitbuf__float_to_half(values[i]);
+    }
+}
+
+static void
+bitbuf__half_to_floats(const uint16_t* values, size_t count, float* out)
+{
+    size_t i = 0;
+
+#if defined(BITBUF__F16C)
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(values + i))));
+    }
+#elif defined(BITBUF__NEON)
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(values + i))));
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = bitbuf__half_to_float(values[i]);
+    }
+}
+
+BITBUFDEF void
+bitbuf_write_half(bitbuf_buffer_t* buf, float value)
+{
+    bitbuf__write_bits(buf, bitbuf__float_to_half(value), 16);
+}
+
+BITBUFDEF float
+bitbuf_read_half(bitbuf_cursor_t* read)
+{
+    return bitbuf__half_to_float((uint16_t)bitbuf_read_n_bits(read, 16, NULL));
+}
+
+BITBUFDEF void
+bitbuf_write_bfloat16(bitbuf_buffer_t* buf, float value)
+{
+    bitbuf__write_bits(buf, bitbuf__float_to_bfloat16(value), 16);
+}
+
+BITBUFDEF float
+bitbuf_read_bfloat16(bitbuf_cursor_t* read)
+{
+    return bitbuf__bfloat16_to_float((uint16_t)bitbuf_read_n_bits(read, 16, NULL));
+}
+
+BITBUFDEF void
+bitbuf_write_half_array(bitbuf_buffer_t* buf, const float* values, size_t count)
+{
+    uint16_t chunk[BITBUF__HALF_CHUNK];
+    size_t   i;
+
+    // reserve once so that chunks are all written or none are
+    if (count == 0 || !bitbuf__reserve(buf, 16 * count))
+        return;
+
+    for (i = 0; i < count; i += BITBUF__HALF_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__HALF_CHUNK);
+
+        bitbuf__floats_to_half(values + i, n, chunk);
+        bitbuf_write_uint16_array(buf, chunk, n);
+    }
+}
+
+BITBUFDEF void
+bitbuf_read_half_array(bitbuf_cursor_t* read, float* out_values, size_t count)
+{
+    uint16_t chunk[BITBUF__HALF_CHUNK];
+    size_t   i;
+
+    if (count == 0)
+        return;
+    if (!bitbuf__can_read(read, 16 * count)) {
+        memset(out_values, 0, count * sizeof(float));
+        return;
+    }
+
+    for (i = 0; i < count; i += BITBUF__HALF_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__HALF_CHUNK);
+
+        bitbuf_read_uint16_array(read, chunk, n);
+        bitbuf__half_to_floats(chunk, n, out_values + i);
+    }
+}
+
+BITBUFDEF void
+bitbuf_write_bfloat16_array(bitbuf_buffer_t* buf, const float* values, size_t count)
+{
+    uint16_t chunk[BITBUF__HALF_CHUNK];
+    size_t   i, j;
+
+    if (count == 0 || !bitbuf__reserve(buf, 16 * count))
+        return;
+
+    for (i = 0; i < count; i += BITBUF__HALF_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__HALF_CHUNK);
+
+        for (j = 0; j < n; j++) {
+            chunk[j] = bitbuf__float_to_bfloat16(values[i + j]);
+        }
+        bitbuf_write_uint16_array(buf, chunk, n);
+    }
+}
+
+BITBUFDEF void
+bitbuf_read_bfloat16_array(bitbuf_cursor_t* read, float* out_values, size_t count)
+{
+    uint16_t chunk[BITBUF__HALF_CHUNK];
+    size_t   i, j;
+
+    if (count == 0)
+        return;
+    if (!bitbuf__can_read(read, 16 * count)) {
+        memset(out_values, 0, count * sizeof(float));
+        return;
+    }
+
+    for (i = 0; i < count; i += BITBUF__HALF_CHUNK) {
+        size_t n = BITBUF__MIN(count - i, (size_t)BITBUF__HALF_CHUNK);
+
+        bitbuf_read_uint16_array(read, chunk, n);
+        for (j = 0; j < n; j++) {
+            out_values[i + j] = bitbuf__bfloat16_to_float(chunk[j]);
+        }
+    }
+}
+
+// per-axis quantization parameters, computed once per call
+typedef struct {
+    int      num_bits[3];
+    uint32_t bit_max[3];
+    float    min[3];
+    float    max[3];
+    float    range[3];
+} bitbuf__vec3_quant_t;
+
+static bitbuf__vec3_quant_t
+bitbuf__vec3_quant(const int num_bits[3], const float min[3], const float max[3])
+{
+    bitbuf__vec3_quant_t quant;
+    int                  axis;
+
+    for (axis = 0; axis < 3; axis++) {
+        BITBUF__ASSERT(num_bits[axis] > 0 && num_bits[axis] <= 31);
+        BITBUF__ASSERT(min[axis] < max[axis]);
+
+        quant.num_bits[axis] = num_bits[axis];
+        quant.bit_max[axis] = (uint32_t)bitbuf__spanmasktable[num_bits[axis]];
+        quant.min[axis] = min[axis];
+        quant.max[axis] = max[axis];
+        quant.range[axis] = max[axis] - min[axis];
+    }
+
+    return quant;
+}
+
+static void
+bitbuf__write_vec3_array(bitbuf_buffer_t*            buf,
+                         const bitbuf__vec3_quant_t* quant,
+                         const float*                vecs,
+                         size_t                      count)
+{
+    const size_t VEC_BITS =
+        (size_t)quant->num_bits[0] + quant->num_bits[1] + quant->num_bits[2];
+    bitbuf__packer_t packer;
+    size_t           i;
+    int              axis;
+
+    if (count == 0 || !bitbuf__reserve(buf, VEC_BITS * count))
+        return;
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < count; i++) {
+        for (axis = 0; axis < 3; axis++) {
+            const float value = vecs[i * 3 + axis];
+
+            BITBUF__ASSERT(value >= quant->min[axis] && value <= quant->max[axis]);
+            bitbuf__pack(&packer,
+                         quant->num_bits[axis],
+                         bitbuf__quantize_float(
+                             value, quant->min[axis], quant->range[axis], quant->bit_max[axis]));
+        }
+    }
+    bitbuf__packer_end(&packer, buf);
+}
+
+static void
+bitbuf__read_vec3_array(bitbuf_cursor_t*            read,
+                        const bitbuf__vec3_quant_t* quant,
+                        float*                      out_vecs,
+                        size_t                      count)
+{
+    const size_t VEC_BITS =
+        (size_t)quant->num_bits[0] + quant->num_bits[1] + quant->num_bits[2];
+    bitbuf__unpacker_t unpacker;
+    size_t             i;
+    int                axis;
+
+    if (count == 0)
+        return;
+    if (!bitbuf__can_read(read, VEC_BITS * count)) {
+        memset(out_vecs, 0, count * 3 * sizeof(float));
+        return;
+    }
+
+    unpacker = bitbuf__unpacker_begin(read);
+    for (i = 0; i < count; i++) {
+        for (axis = 0; axis < 3; axis++) {
+            out_vecs[i * 3 + axis] =
+                bitbuf__dequantize_float(bitbuf__unpack(&unpacker, quant->num_bits[axis]),
+                                         quant->min[axis],
+                                         quant->range[axis],
+                                         quant->bit_max[axis]);
+        }
+    }
+    bitbuf__unpacker_end(&unpacker, read);
+}
+
+BITBUFDEF void
+bitbuf_write_quantized_vec3_array(bitbuf_buffer_t* buf,
+                                  int              num_bits,
+                                  float            min,
+                                  float            max,
+                                  const float*     vecs,
+                                  size_t           count)
+{
+    // with a shared range, the layout is that of a float array
+    bitbuf_write_quantized_float_array(buf, num_bits, min, max, vecs, count * 3);
+}
+
+BITBUFDEF void
+bitbuf_read_quantized_vec3_array(bitbuf_cursor_t* read,
+                                 int              num_bits,
+                                 float            min,
+                                 float            max,
+                                 float*           out_vecs,
+                                 size_t           count)
+{
+    bitbuf_read_quantized_float_array(read, num_bits, min, max, out_vecs, count * 3);
+}
+
+BITBUFDEF void
+bitbuf_write_quantized_vec3_axes_array(bitbuf_buffer_t* buf,
+                                       const int        num_bits[3],
+                                       const float      min[3],
+                                       const float      max[3],
+                                       const float*     vecs,
+                                       size_t           count)
+{
+    bitbuf__vec3_quant_t quant = bitbuf__vec3_quant(num_bits, min, max);
+    bitbuf__write_vec3_array(buf, &quant, vecs, count);
+}
+
+BITBUFDEF void
+bitbuf_read_quantized_vec3_axes_array(bitbuf_cursor_t* read,
+                                      const int        num_bits[3],
+                                      const float      min[3],
+                                      const float      max[3],
+                                      float*           out_vecs,
+                                      size_t           count)
+{
+    bitbuf__vec3_quant_t quant = bitbuf__vec3_quant(num_bits, min, max);
+    bitbuf__read_vec3_array(read, &quant, out_vecs, count);
+}
+
+BITBUFDEF void
+bitbuf_write_quantized_vec3(
+    bitbuf_buffer_t* buf, int num_bits, float min, float max, const float v[3])
+{
+    bitbuf_write_quantized_vec3_array(buf, num_bits, min, max, v, 1);
+}
+
+BITBUFDEF void
+bitbuf_read_quantized_vec3(
+    bitbuf_cursor_t* read, int num_bits, float min, float max, float out_v[3])
+{
+    bitbuf_read_quantized_vec3_array(read, num_bits, min, max, out_v, 1);
+}
+
+BITBUFDEF void
+bitbuf_write_quantized_vec3_axes(bitbuf_buffer_t* buf,
+                                 const int        num_bits[3],
+                                 const float      min[3],
+                                 const float      max[3],
+                                 const float      v[3])
+{
+    bitbuf_write_quantized_vec3_axes_array(buf, num_bits, min, max, v, 1);
+}
+
+BITBUFDEF void
+bitbuf_read_quantized_vec3_axes(bitbuf_cursor_t* read,
+                                const int        num_bits[3],
+                                const float      min[3],
+                                const float      max[3],
+                                float            out_v[3])
+{
+    bitbuf_read_quantized_vec3_axes_array(read, num_bits, min, max, out_v, 1);
+}
+
+// the three smallest components of a unit quaternion lie in
+// [-1/sqrt(2), 1/sqrt(2)]
+#define BITBUF__QUAT_MIN (-0.707106781186547524f)
+#define BITBUF__QUAT_RANGE (2.0f * 0.707106781186547524f)
+
+BITBUFDEF void
+bitbuf_write_quat_array(bitbuf_buffer_t* buf, int num_bits, const float* quats, size_t count)
+{
+    BITBUF__ASSERT(num_bits > 0 && num_bits <= 31);
+
+    const uint32_t   BIT_MAX = (uint32_t)bitbuf__spanmasktable[num_bits];
+    bitbuf__packer_t packer;
+    size_t           i;
+    int              c;
+
+    if (count == 0 || !bitbuf__reserve(buf, (2 + 3 * (size_t)num_bits) * count))
+        return;
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < count; i++) {
+        const float* q = quats + i * 4;
+        int          largest = 0;
+
+        for (c = 1; c < 4; c++) {
+            if (fabsf(q[c]) > fabsf(q[largest]))
+                largest = c;
+        }
+
+        // negate so the dropped component is positive
+        const float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+        bitbuf__pack(&packer, 2, (uint64_t)largest);
+        for (c = 0; c < 4; c++) {
+            if (c == largest)
+                continue;
+
+            // rounding may put a component just outside the range
+            float value = BITBUF__MIN(BITBUF__MAX(q[c] * sign, BITBUF__QUAT_MIN),
+                                      BITBUF__QUAT_MIN + BITBUF__QUAT_RANGE);
+
+            bitbuf__pack(
+                &packer,
+                num_bits,
+                bitbuf__quantize_float(value, BITBUF__QUAT_MIN, BITBUF__QUAT_RANGE, BIT_MAX));
+        }
+    }
+    bitbuf__packer_end(&packer, buf);
+}
+
+BITBUFDEF void
+bitbuf_read_quat_array(bitbuf_cursor_t* read, int num_bits, float* out_quats, size_t count)
+{
+    BITBUF__ASSERT(num_bits > 0 && num_bits <= 31);
+
+    const uint32_t     BIT_MAX = (uint32_t)bitbuf__spanmasktable[num_bits];
+    bitbuf__unpacker_t unpacker;
+    size_t             i;
+    int                c;
+
+    if (count == 0)
+        return;
+    if (!bitbuf__can_read(read, (2 + 3 * (size_t)num_bits) * count)) {
+        memset(out_quats, 0, count * 4 * sizeof(float));
+        return;
+    }
+
+    unpacker = bitbuf__unpacker_begin(read);
+    for (i = 0; i < count; i++) {
+        float*    q = out_quats + i * 4;
+        const int largest = (int)bitbuf__unpack(&unpacker, 2);
+        float     sum_sq = 0.0f;
+
+        for (c = 0; c < 4; c++) {
+            if (c == largest)
+                continue;
+
+            q[c] = bitbuf__dequantize_float(bitbuf__unpack(&unpacker, num_bits),
+                                            BITBUF__QUAT_MIN,
+                                            BITBUF__QUAT_RANGE,
+                                            BIT_MAX);
+            sum_sq += q[c] * q[c];
+        }
+
+        q[largest] = sqrtf(BITBUF__MAX(1.0f - sum_sq, 0.0f));
+    }
+    bitbuf__unpacker_end(&unpacker, read);
+}
+
+BITBUFDEF void
+bitbuf_write_quat(bitbuf_buffer_t* buf, int num_bits, const float q[4])
+{
+    bitbuf_write_quat_array(buf, num_bits, q, 1);
+}
+
+BITBUFDEF void
+bitbuf_read_quat(bitbuf_cursor_t* read, int num_bits, float out_q[4])
+{
+    bitbuf_read_quat_array(read, num_bits, out_q, 1);
+}
+
+BITBUFDEF int
+bitbuf_bits_for_range(int64_t min, int64_t max)
+{
+    BITBUF__ASSERT(min <= max);
+
+    return bitbuf__bit_width((uint64_t)max - (uint64_t)min);
+}
+
+BITBUFDEF void
+bitbuf_write_ranged_int(bitbuf_buffer_t* buf, int64_t min, int64_t max, int64_t value)
+{
+    BITBUF__ASSERT(value >= min && value <= max);
+
+    bitbuf__write_bits(buf, (uint64_t)value - (uint64_t)min, bitbuf_bits_for_range(min, max));
+}
+
+BITBUFDEF int64_t
+bitbuf_read_ranged_int(bitbuf_cursor_t* read, int64_t min, int64_t max)
+{
+    int num_bits = bitbuf_bits_for_range(min, max);
+
+    // a single value range takes no bits
+    if (num_bits == 0)
+        return min;
+
+    uint64_t offset = bitbuf__read_bits(read, num_bits);
+
+    // if this is hit, the value was not written with the same range
+    BITBUF__ASSERT(offset <= (uint64_t)max - (uint64_t)min);
+
+    return (int64_t)((uint64_t)min + offset);
+}
+
+// read cursor for a buffer that may still be written to.  Unlike
+// bitbuf_cursor_init(), the buffer is not modified.
+static bitbuf_cursor_t
+bitbuf__cursor_for(const bitbuf_buffer_t* buffer)
+{
+    bitbuf_cursor_t cursor;
+
+    cursor.seg = buffer->data;
+    cursor.bits_into_seg = 0;
+    cursor.owner = buffer;
+    cursor.read_past_end = 0;
+
+    return cursor;
+}
+
+static size_t
+bitbuf__layout_bits(const int* field_bits, size_t num_fields)
+{
+    size_t total = 0;
+    size_t i;
+
+    for (i = 0; i < num_fields; i++) {
+        BITBUF__ASSERT(field_bits[i] > 0 && field_bits[i] <= 64);
+        total += field_bits[i];
+    }
+
+    return total;
+}
+
+// true if the first num_bits of two buffers are identical
+static bool
+bitbuf__bits_equal(const bitbuf_buffer_t* a, const bitbuf_buffer_t* b, size_t num_bits)
+{
+    size_t full_segs = num_bits / BITBUF__SEG_BITS;
+    int    tail_bits = (int)(num_bits % BITBUF__SEG_BITS);
+
+    if (memcmp(a->data, b->data, full_segs * sizeof(uint64_t)) != 0)
+        return false;
+
+    return tail_bits == 0 ||
+           ((bitbuf__load_seg(a->data + full_segs, bitbuf__buffer_end(a)) ^
+             bitbuf__load_seg(b->data + full_segs, bitbuf__buffer_end(b))) &
+            bitbuf__low_mask(tail_bits)) == 0;
+}
+
+BITBUFDEF void
+bitbuf_write_delta(bitbuf_buffer_t*       buf,
+                   const bitbuf_buffer_t* baseline,
+                   const bitbuf_buffer_t* current,
+                   const int*             field_bits,
+                   size_t                 num_fields)
+{
+    const size_t    TOTAL_BITS = bitbuf__layout_bits(field_bits, num_fields);
+    bitbuf_cursor_t base_cursor = bitbuf__cursor_for(baseline);
+    bitbuf_cursor_t cur_cursor = bitbuf__cursor_for(current);
+    bitbuf_reader_t base, cur;
+    bitbuf_writer_t writer;
+    size_t          i;
+
+    // if this is hit, a buffer holds fewer bits than the layout describes
+    BITBUF__ASSERT(bitbuf__cursor_pos(&baseline->write, baseline->data) >= TOTAL_BITS);
+    BITBUF__ASSERT(bitbuf__cursor_pos(&current->write, current->data) >= TOTAL_BITS);
+
+    bool changed = !bitbuf__bits_equal(baseline, current, TOTAL_BITS);
+    bitbuf_write_bool(buf, changed);
+    if (!changed)
+        return;
+
+    writer = bitbuf_writer_begin(buf);
+
+    // change mask
+    base = bitbuf_reader_init_at(&base_cursor);
+    cur = bitbuf_reader_init_at(&cur_cursor);
+    for (i = 0; i < num_fields; i++) {
+        uint64_t base_value = bitbuf_reader_read_n_bits(&base, field_bits[i]);
+        uint64_t cur_value = bitbuf_reader_read_n_bits(&cur, field_bits[i]);
+
+        bitbuf_writer_write_n_bits(&writer, 1, base_value != cur_value);
+    }
+
+    // changed values
+    base = bitbuf_reader_init_at(&base_cursor);
+    cur = bitbuf_reader_init_at(&cur_cursor);
+    for (i = 0; i < num_fields; i++) {
+        uint64_t base_value = bitbuf_reader_read_n_bits(&base, field_bits[i]);
+        uint64_t cur_value = bitbuf_reader_read_n_bits(&cur, field_bits[i]);
+
+        if (base_value != cur_value)
+            bitbuf_writer_write_n_bits(&writer, field_bits[i], cur_value);
+    }
+
+    bitbuf_writer_end(&writer);
+}
+
+BITBUFDEF void
+bitbuf_read_delta(bitbuf_cursor_t*       read,
+                  const bitbuf_buffer_t* baseline,
+                  bitbuf_buffer_t*       out,
+                  const int*             field_bits,
+                  size_t                 num_fields)
+{
+    bitbuf_cursor_t base_cursor = bitbuf__cursor_for(baseline);
+    bitbuf_reader_t base = bitbuf_reader_init_at(&base_cursor);
+    bitbuf_writer_t writer;
+    size_t          i;
+
+    BITBUF__ASSERT(bitbuf__cursor_pos(&baseline->write, baseline->data) >=
+                   bitbuf__layout_bits(field_bits, num_fields));
+
+    bool changed = bitbuf_read_bool(read);
+
+    if (!changed) {
+        writer = bitbuf_writer_begin(out);
+        for (i = 0; i < num_fields; i++) {
+            bitbuf_writer_write_n_bits(
+                &writer, field_bits[i], bitbuf_reader_read_n_bits(&base, field_bits[i]));
+        }
+        bitbuf_writer_end(&writer);
+        return;
+    }
+
+    if (!bitbuf__can_read(read, num_fields))
+        return;
+
+    // the mask and values are read in parallel
+    bitbuf_cursor_t values_cursor = *read;
+    bitbuf__set_cursor_pos(&values_cursor,
+                           read->owner->data,
+                           bitbuf__cursor_pos(read, read->owner->data) + num_fields);
+
+    bitbuf_reader_t mask = bitbuf_reader_init_at(read);
+    bitbuf_reader_t values = bitbuf_reader_init_at(&values_cursor);
+
+    writer = bitbuf_writer_begin(out);
+    for (i = 0; i < num_fields; i++) {
+        uint64_t value = bitbuf_reader_read_n_bits(&base, field_bits[i]);
+
+        if (bitbuf_reader_read_n_bits(&mask, 1))
+            value = bitbuf_reader_read_n_bits(&values, field_bits[i]);
+
+        bitbuf_writer_write_n_bits(&writer, field_bits[i], value);
+    }
+    bitbuf_writer_end(&writer);
+
+    *read = bitbuf_reader_get_cursor(&values);
+}
+
+BITBUFDEF void
+bitbuf_write_varint_u64(bitbuf_buffer_t* buf, int group_bits, uint64_t value)
+{
+    BITBUF__ASSERT(group_bits > 0 && group_bits < 64);
+
+    const uint64_t   GROUP_MASK = bitbuf__low_mask(group_bits);
+    const uint64_t   CONT_BIT = 1ull << group_bits;
+    int              num_groups = (bitbuf__bit_width(value) + group_bits - 1) / group_bits;
+    bitbuf__packer_t packer;
+    int              i;
+
+    num_groups = BITBUF__MAX(num_groups, 1);
+    if (!bitbuf__reserve(buf, (size_t)num_groups * (group_bits + 1)))
+        return;
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < num_groups - 1; i++) {
+        bitbuf__pack(&packer, group_bits + 1, (value & GROUP_MASK) | CONT_BIT);
+        value >>= group_bits;
+    }
+    bitbuf__pack(&packer, group_bits + 1, value);
+    bitbuf__packer_end(&packer, buf);
+}
+
+BITBUFDEF void
+bitbuf_write_varint_i64(bitbuf_buffer_t* buf, int group_bits, int64_t value)
+{
+    bitbuf_write_varint_u64(buf, group_bits, bitbuf__zigzag_encode(value));
+}
+
+// gather the payload bits of the num_bits long varint at the bottom of word
+static uint64_t
+bitbuf__varint_payload(uint64_t word, int group_bits, int num_bits)
+{
+#if defined(__BMI2__)
+    return _pext_u64(word & bitbuf__low_mask(num_bits),
+                     ~bitbuf__varint_contmasktable[group_bits]);
+#else
+    const uint64_t GROUP_MASK = bitbuf__low_mask(group_bits);
+    uint64_t       value = 0;
+    int            shift = 0;
+    int            i;
+
+    for (i = 0; i < num_bits; i += group_bits + 1) {
+        value |= ((word >> i) & GROUP_MASK) << shift;
+        shift += group_bits;
+    }
+
+    return value;
+#endif
+}
+
+BITBUFDEF uint64_t
+bitbuf_read_varint_u64(bitbuf_cursor_t* read, int group_bits)
+{
+    BITBUF__ASSERT(group_bits > 0 && group_bits < 64);
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+
+    // find the first clear continuation bit in the next 64 bits
+    ptrdiff_t remaining = bitbuf__bits_remaining_for_cursor(read->owner, read);
+    int       window_bits = (int)BITBUF__MIN(remaining, 64);
+    uint64_t  word = bitbuf_peek_n_bits(read, window_bits);
+    uint64_t  stops =
+        ~word & bitbuf__varint_contmasktable[group_bits] & bitbuf__low_mask(window_bits);
+
+    if (stops) {
+        int num_bits = bitbuf__ctz64(stops) + 1;
+
+        bitbuf__set_cursor_pos(
+            read, read->owner->data, bitbuf__cursor_pos(read, read->owner->data) + num_bits);
+
+        return bitbuf__varint_payload(word, group_bits, num_bits);
+    }
+
+    // slow path: longer than 64 bits, or runs off the end of the buffer
+    const uint64_t GROUP_MASK = bitbuf__low_mask(group_bits);
+    const int      MAX_GROUPS = (64 + group_bits - 1) / group_bits;
+    uint64_t       value = 0;
+    int            i;
+
+    for (i = 0; i < MAX_GROUPS; i++) {
+        if (!bitbuf__can_read(read, (size_t)group_bits + 1))
+            return 0;
+
+        uint64_t group = bitbuf__read_bits(read, group_bits + 1);
+
+        value |= (group & GROUP_MASK) << (i * group_bits);
+        if ((group >> group_bits) == 0)
+            return value;
+    }
+
+    BITBUF__ASSERT_FAIL("varint exceeds 64 bits");
+    return value;
+}
+
+BITBUFDEF int64_t
+bitbuf_read_varint_i64(bitbuf_cursor_t* read, int group_bits)
+{
+    return bitbuf__zigzag_decode(bitbuf_read_varint_u64(read, group_bits));
+}
+
+// longest zero run written; a growable buffer is not grown without
+// bound for one code
+#define BITBUF__MAX_UNARY_ZEROS ((uint64_t)1 << 24)
+
+// write zeros zero bits, a one bit, then the low num_bits (0..63) of
+// bits.  the common short code is a single write.
+static void
+bitbuf__write_unary_code(bitbuf_buffer_t* buf, uint64_t zeros, uint64_t bits, int num_bits)
+{
+    uint64_t code = ((bits & bitbuf__low_mask(num_bits)) << 1) | 1;
+    size_t   code_bits;
+
+    if (zeros < (uint64_t)(64 - num_bits)) {
+        bitbuf__write_bits(buf, code << zeros, (int)zeros + num_bits + 1);
+        return;
+    }
+
+    if (zeros > BITBUF__MAX_UNARY_ZEROS) {
+        if (!buf->open_checkpoints)
+            BITBUF__ASSERT_FAIL("unary code too long");
+        buf->truncated |= 1;
+        return;
+    }
+
+    // a long code is reserved whole, so one that does not fit is
+    // refused rather than written in part
+    code_bits = (size_t)zeros + num_bits + 1;
+    if ((size_t)bitbuf__remaining_capacity_in_bits(buf) < code_bits &&
+        !bitbuf__reserve_slow(buf, code_bits))
+        return;
+
+    for (; zeros >= 64; zeros -= 64) {
+        bitbuf__write_bits(buf, 0, 64);
+    }
+    bitbuf__write_bits(buf, 0, (int)(zeros % 64));
+    bitbuf__write_bits(buf, code, num_bits + 1);
+}
+
+BITBUFDEF void
+bitbuf_write_rice(bitbuf_buffer_t* buf, int k, uint64_t value)
+{
+    BITBUF__ASSERT(k >= 0 && k < 64);
+
+    bitbuf__write_unary_code(buf, value >> k, value, k);
+}
+
+BITBUFDEF void
+bitbuf_write_elias_gamma(bitbuf_buffer_t* buf, uint64_t value)
+{
+    BITBUF__ASSERT(value < UINT64_MAX);
+
+    uint64_t coded = value + 1;
+    int      width = bitbuf__bit_width(coded) - 1;
+
+    bitbuf__write_unary_code(buf, (uint64_t)width, coded, width);
+}
+
+BITBUFDEF void
+bitbuf_write_elias_delta(bitbuf_buffer_t* buf, uint64_t value)
+{
+    BITBUF__ASSERT(value < UINT64_MAX);
+
+    // the bit width of value + 1 in elias gamma, then the bits below
+    // its leading one
+    uint64_t coded = value + 1;
+    int      width = bitbuf__bit_width(coded) - 1;
+    uint64_t len = (uint64_t)width + 1;
+    int      len_width = bitbuf__bit_width(len) - 1;
+
+    // reserved whole, so the length is not written without the bits
+    if (!bitbuf__reserve(buf, (size_t)len_width * 2 + 1 + width))
+        return;
+
+    bitbuf__write_unary_code(buf, (uint64_t)len_width, len, len_width);
+    bitbuf__write_bits(buf, coded, width);
+}
+
+static bool
+bitbuf__universal_corrupt(int* read_past_end)
+{
+    BITBUF__ASSERT_FAIL("malformed universal code");
+    *read_past_end |= 1;
+    return false;
+}
+
+// the readers below report failure of each read from its own checks,
+// not from read_past_end, which may be left set by an earlier read.
+
+// read a run of zero bits and the one bit ending it, returning the
+// length of the run in *out_zeros
+static bool
+bitbuf__read_unary(bitbuf_cursor_t* read, uint64_t* out_zeros)
+{
+    uint64_t zeros = 0;
+
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+
+    for (;;) {
+        ptrdiff_t remaining = bitbuf__bits_remaining_for_cursor(read->owner, read);
+        uint64_t  word = bitbuf_peek_n_bits(read, 64);
+        size_t    pos = bitbuf__cursor_pos(read, read->owner->data);
+
+        // peeked bits past the end are zero, so a one is in the buffer
+        if (word) {
+            int run = bitbuf__ctz64(word);
+
+            bitbuf__set_cursor_pos(read, read->owner->data, pos + run + 1);
+            *out_zeros = zeros + run;
+            return true;
+        }
+
+        if (remaining <= 64)
+            return bitbuf__universal_corrupt(&read->read_past_end);
+
+        bitbuf__set_cursor_pos(read, read->owner->data, pos + 64);
+        zeros += 64;
+    }
+}
+
+// the elias gamma code of a value of 1 or more
+static bool
+bitbuf__read_gamma(bitbuf_cursor_t* read, uint64_t* out_value)
+{
+    uint64_t width;
+
+    if (!bitbuf__read_unary(read, &width))
+        return false;
+    if (width > 63)
+        return bitbuf__universal_corrupt(&read->read_past_end);
+    if (!bitbuf__can_read(read, (size_t)width))
+        return false;
+
+    *out_value = (1ull << width) | bitbuf__read_bits(read, (int)width);
+    return true;
+}
+
+BITBUFDEF uint64_t
+bitbuf_read_rice(bitbuf_cursor_t* read, int k)
+{
+    BITBUF__ASSERT(k >= 0 && k < 64);
+
+    uint64_t quotient;
+
+    if (!bitbuf__read_unary(read, &quotient))
+        return 0;
+    if (k > 0 && (quotient >> (64 - k)) != 0) {
+        bitbuf__universal_corrupt(&read->read_past_end);
+        return 0;
+    }
+    if (!bitbuf__can_read(read, (size_t)k))
+        return 0;
+
+    return (quotient << k) | bitbuf__read_bits(read, k);
+}
+
+BITBUFDEF uint64_t
+bitbuf_read_elias_gamma(bitbuf_cursor_t* read)
+{
+    uint64_t coded;
+
+    return bitbuf__read_gamma(read, &coded) ? coded - 1 : 0;
+}
+
+BITBUFDEF uint64_t
+bitbuf_read_elias_delta(bitbuf_cursor_t* read)
+{
+    uint64_t len;
+
+    if (!bitbuf__read_gamma(read, &len))
+        return 0;
+    if (len > 64) {
+        bitbuf__universal_corrupt(&read->read_past_end);
+        return 0;
+    }
+
+    int width = (int)len - 1;
+
+    if (!bitbuf__can_read(read, (size_t)width))
+        return 0;
+
+    return ((1ull << width) | bitbuf__read_bits(read, width)) - 1;
+}
+
+// as bitbuf__can_read, for a reader
+static bool
+bitbuf__reader_can_read(bitbuf_reader_t* reader, int num_bits)
+{
+    if (num_bits <= reader->cur_bits || reader->next_seg < reader->num_segs)
+        return true;
+
+    BITBUF__ASSERT_FAIL("read past end of buffer");
+    reader->read_past_end |= 1;
+
+    return false;
+}
+
+// as bitbuf__read_unary.  the run's end is usually in cur, as bits of
+// cur above cur_bits are zero.
+static bool
+bitbuf__reader_read_unary(bitbuf_reader_t* reader, uint64_t* out_zeros)
+{
+    uint64_t zeros = 0;
+
+    while (reader->cur == 0) {
+        if (reader->next_seg >= reader->num_segs)
+            return bitbuf__universal_corrupt(&reader->read_past_end);
+
+        zeros += (uint64_t)reader->cur_bits;
+        reader->cur = reader->next;
+        reader->cur_bits = BITBUF__SEG_BITS;
+        reader->next_seg++;
+        reader->next = bitbuf__reader_load(reader, reader->next_seg);
+    }
+
+    int run = bitbuf__ctz64(reader->cur);
+
+    reader->cur = (reader->cur >> run) >> 1;
+    reader->cur_bits -= run + 1;
+
+    *out_zeros = zeros + run;
+    return true;
+}
+
+static bool
+bitbuf__reader_read_gamma(bitbuf_reader_t* reader, uint64_t* out_value)
+{
+    uint64_t width;
+
+    if (!bitbuf__reader_read_unary(reader, &width))
+        return false;
+    if (width > 63)
+        return bitbuf__universal_corrupt(&reader->read_past_end);
+    if (!bitbuf__reader_can_read(reader, (int)width))
+        return false;
+
+    *out_value = (1ull << width) | bitbuf_reader_read_n_bits(reader, (int)width);
+    return true;
+}
+
+BITBUFDEF uint64_t
+bitbuf_reader_read_rice(bitbuf_reader_t* reader, int k)
+{
+    BITBUF__ASSERT(k >= 0 && k < 64);
+
+    uint64_t quotient;
+
+    if (!bitbuf__reader_read_unary(reader, &quotient))
+        return 0;
+    if (k > 0 && (quotient >> (64 - k)) != 0) {
+        bitbuf__universal_corrupt(&reader->read_past_end);
+        return 0;
+    }
+    if (!bitbuf__reader_can_read(reader, k))
+        return 0;
+
+    return (quotient << k) | bitbuf_reader_read_n_bits(reader, k);
+}
+
+BITBUFDEF uint64_t
+bitbuf_reader_read_elias_gamma(bitbuf_reader_t* reader)
+{
+    uint64_t coded;
+
+    return bitbuf__reader_read_gamma(reader, &coded) ? coded - 1 : 0;
+}
+
+BITBUFDEF uint64_t
+bitbuf_reader_read_elias_delta(bitbuf_reader_t* reader)
+{
+    uint64_t len;
+
+    if (!bitbuf__reader_read_gamma(reader, &len))
+        return 0;
+    if (len > 64) {
+        bitbuf__universal_corrupt(&reader->read_past_end);
+        return 0;
+    }
+
+    int width = (int)len - 1;
+
+    if (!bitbuf__reader_can_read(reader, width))
+        return 0;
+
+    return ((1ull << width) | bitbuf_reader_read_n_bits(reader, width)) - 1;
+}
+
+BITBUFDEF void
+bitbuf_write_bytes(bitbuf_buffer_t* buf, const void* bytes, size_t num_bytes)
+{
+    const uint8_t*   src = (const uint8_t*)bytes;
+    bitbuf__packer_t packer;
+    size_t           i;
+
+    if (num_bytes == 0 || !bitbuf__reserve(buf, num_bytes * 8))
+        return;
+    if (bitbuf__copy_array_to_buffer(buf, 8, bytes, num_bytes, 1))
+        return;
+
+    // unaligned: shift whole words into place
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i + 8 <= num_bytes; i += 8) {
+        bitbuf__pack(&packer, 64, bitbuf__load_le64(src + i));
+    }
+    for (; i < num_bytes; i++) {
+        bitbuf__pack(&packer, 8, src[i]);
+    }
+    bitbuf__packer_end(&packer, buf);
+}
+
+#ifdef BITBUF_HAS_IOVEC
+BITBUFDEF size_t
+bitbuf_export_iovec(const bitbuf_buffer_t* const* bufs, size_t num_bufs, struct iovec* out_iov)
+{
+    size_t total_bytes = 0;
+    size_t i;
+
+    for (i = 0; i < num_bufs; i++) {
+        size_t num_bytes;
+
+        BITBUF__ASSERT(!bufs[i]->measuring);
+
+        out_iov[i].iov_base = (void*)bitbuf_get_bytes_from_buffer(bufs[i], &num_bytes);
+        out_iov[i].iov_len = num_bytes;
+        total_bytes += num_bytes;
+    }
+
+    return total_bytes;
+}
+#endif
+
+// copy num_bits starting src_shift bits into src to the write cursor
+// of dst.  the bits must be known to be in the source, and capacity
+// reserved for them.
+static void
+bitbuf__splice_bits(bitbuf_buffer_t* dst,
+                    const uint64_t*  src,
+                    int              src_shift,
+                    const uint8_t*   src_end,
+                    size_t           num_bits)
+{
+    uint64_t* out = dst->write.seg;
+    int       out_shift = dst->write.bits_into_seg;
+    uint64_t  accum = out_shift ? *out : 0;
+    size_t    num_words = num_bits / BITBUF__SEG_BITS;
+    int       tail_bits = (int)(num_bits % BITBUF__SEG_BITS);
+    ptrdiff_t whole_segs = (src_end - (const uint8_t*)src) / (ptrdiff_t)sizeof(uint64_t);
+    size_t    fast_words = whole_segs > 1 ? BITBUF__MIN(num_words, (size_t)whole_segs - 1) : 0;
+    uint64_t  cur = bitbuf__load_seg(src, src_end);
+    uint64_t  next, word;
+    size_t    i;
+
+    // funnel shift each pair of source words into one output word.  the
+    // split shifts give 0 rather than shifting by 64 when a side is
+    // aligned, so the loop does not branch on the offsets.
+    for (i = 0; i < fast_words; i++) {
+        memcpy(&next, src + i + 1, sizeof(uint64_t));
+        word = (cur >> src_shift) | ((next << (63 - src_shift)) << 1);
+        *out++ = accum | (word << out_shift);
+        accum = (word >> (63 - out_shift)) >> 1;
+        cur = next;
+    }
+
+    // the final source words may be partial
+    for (; i < num_words; i++) {
+        next = bitbuf__load_seg(src + i + 1, src_end);
+        word = (cur >> src_shift) | ((next << (63 - src_shift)) << 1);
+        *out++ = accum | (word << out_shift);
+        accum = (word >> (63 - out_shift)) >> 1;
+        cur = next;
+    }
+
+    if (tail_bits) {
+        next = src_shift + tail_bits > BITBUF__SEG_BITS ? bitbuf__load_seg(src + i + 1, src_end)
+                                                        : 0;
+        word = (cur >> src_shift) | ((next << (63 - src_shift)) << 1);
+        word &= bitbuf__low_mask(tail_bits);
+
+        accum |= word << out_shift;
+        out_shift += tail_bits;
+        if (out_shift >= BITBUF__SEG_BITS) {
+            *out++ = accum;
+            out_shift -= BITBUF__SEG_BITS;
+            accum = (word >> 1) >> (tail_bits - out_shift - 1);
+        }
+    }
+
+    if (out_shift)
+        *out = accum;
+
+    dst->write.seg = out;
+    dst->write.bits_into_seg = out_shift;
+}
+
+BITBUFDEF void
+bitbuf_concat_buffers(bitbuf_buffer_t*              dst,
+                      const bitbuf_buffer_t* const* srcs,
+                      size_t                        num_srcs)
+{
+    size_t total_bits = 0;
+    size_t i;
+
+    for (i = 0; i < num_srcs; i++) {
+        BITBUF__ASSERT(srcs[i] != dst && !srcs[i]->measuring);
+        total_bits += bitbuf_num_bits_written(srcs[i]);
+    }
+
+    if (total_bits == 0 || !bitbuf__reserve(dst, total_bits))
+        return;
+
+    for (i = 0; i < num_srcs; i++) {
+        size_t num_bits = bitbuf_num_bits_written(srcs[i]);
+
+        if (num_bits)
+            bitbuf__splice_bits(dst, srcs[i]->data, 0, bitbuf__buffer_end(srcs[i]), num_bits);
+    }
+}
+
+BITBUFDEF void
+bitbuf_append_buffer(bitbuf_buffer_t* dst, const bitbuf_buffer_t* src)
+{
+    bitbuf_concat_buffers(dst, &src, 1);
+}
+
+BITBUFDEF void
+bitbuf_append_bits(bitbuf_buffer_t* dst, bitbuf_cursor_t* read, size_t num_bits)
+{
+    size_t bit_pos;
+
+    BITBUF__ASSERT(read->owner != dst);
+
+    if (num_bits == 0 || !bitbuf__can_read(read, num_bits))
+        return;
+
+    if (bitbuf__reserve(dst, num_bits)) {
+        bitbuf__splice_bits(dst,
+                            read->seg,
+                            read->bits_into_seg,
+                            bitbuf__buffer_end(read->owner),
+                            num_bits);
+    }
+
+    bit_pos = bitbuf__cursor_pos(read, read->owner->data) + num_bits;
+    bitbuf__set_cursor_pos(read, read->owner->data, bit_pos);
+}
+
+// fragment payload sizes are varints in 7-bit groups
+#define BITBUF__FRAGMENT_VARINT_BITS 7
+
+BITBUFDEF bitbuf_fragmenter_t
+bitbuf_fragmenter_init(const bitbuf_buffer_t* message,
+                       uint16_t               message_id,
+                       size_t                 fragment_bytes)
+{
+    bitbuf_fragmenter_t frag;
+    size_t              fragment_bits = fragment_bytes * 8;
+
+    BITBUF__ASSERT(!message->measuring);
+    BITBUF__ASSERT(fragment_bytes > 0);
+
+    frag.message = message;
+    frag.num_bits = bitbuf_num_bits_written(message);
+    frag.fragment_bytes = fragment_bytes;
+    frag.num_fragments = (int)BITBUF__MAX((frag.num_bits + fragment_bits - 1) / fragment_bits, 1);
+    frag.message_id = message_id;
+
+    // if this is hit, increase fragment_bytes
+    BITBUF__ASSERT(frag.num_fragments <= BITBUF_MAX_FRAGMENTS);
+
+    return frag;
+}
+
+static size_t
+bitbuf__fragment_bits(const bitbuf_fragmenter_t* frag, int index)
+{
+    BITBUF__ASSERT(index >= 0 && index < frag->num_fragments);
+
+    return BITBUF__MIN(frag->num_bits - (size_t)index * frag->fragment_bytes * 8,
+                       frag->fragment_bytes * 8);
+}
+
+BITBUFDEF void
+bitbuf_write_fragment_header(bitbuf_buffer_t* buf, const bitbuf_fragmenter_t* frag, int index)
+{
+    int last_index = frag->num_fragments - 1;
+
+    bitbuf_write_uint16(buf, frag->message_id);
+    bitbuf_write_uint8(buf, (uint8_t)index);
+    bitbuf_write_uint8(buf, (uint8_t)last_index);
+    bitbuf_write_varint_u64(buf, BITBUF__FRAGMENT_VARINT_BITS, frag->fragment_bytes);
+    if (index == last_index) {
+        bitbuf_write_varint_u64(
+            buf, BITBUF__FRAGMENT_VARINT_BITS, bitbuf__fragment_bits(frag, index));
+    }
+    bitbuf_pad_to_byte(buf);
+}
+
+BITBUFDEF void
+bitbuf_write_fragment(bitbuf_buffer_t* buf, const bitbuf_fragmenter_t* frag, int index)
+{
+    bitbuf_cursor_t read = bitbuf__cursor_for(frag->message);
+
+    bitbuf_write_fragment_header(buf, frag, index);
+
+    bitbuf_cursor_seek_bits(&read, (size_t)index * frag->fragment_bytes * 8);
+    bitbuf_append_bits(buf, &read, bitbuf__fragment_bits(frag, index));
+}
+
+BITBUFDEF bitbuf_buffer_t
+bitbuf_fragment_payload(const bitbuf_fragmenter_t* frag, int index)
+{
+    const uint8_t* bytes = (const uint8_t*)frag->message->data;
+
+    if (!BITBUF__LITTLE_ENDIAN)
+        return bitbuf_init_buffer_with_bytes(NULL, 0);
+
+    return bitbuf_init_buffer_with_bytes(bytes + (size_t)index * frag->fragment_bytes,
+                                         (bitbuf__fragment_bits(frag, index) + 7) / 8);
+}
+
+BITBUFDEF bitbuf_reassembler_t
+bitbuf_reassembler_init(bitbuf_buffer_t* dest)
+{
+    bitbuf_reassembler_t reasm;
+    memset(&reasm, 0, sizeof(reasm));
+
+    BITBUF__ASSERT_NO_WRITE_AFTER_READS(dest);
+    BITBUF__ASSERT(bitbuf_num_bits_written(dest) == 0 && !dest->measuring);
+
+    reasm.dest = dest;
+
+    return reasm;
+}
+
+static bool
+bitbuf__reassembler_add_fragment(bitbuf_reassembler_t* reasm, bitbuf_cursor_t* read)
+{
+    uint16_t message_id = bitbuf_read_uint16(read);
+    int      index = bitbuf_read_uint8(read);
+    int      num_fragments = bitbuf_read_uint8(read) + 1;
+    uint64_t fragment_bytes = bitbuf_read_varint_u64(read, BITBUF__FRAGMENT_VARINT_BITS);
+    uint64_t num_bits = fragment_bytes * 8;
+    size_t   offset_bytes, end_bits;
+    uint8_t* dest_bytes;
+
+    if (index + 1 == num_fragments)
+        num_bits = bitbuf_read_varint_u64(read, BITBUF__FRAGMENT_VARINT_BITS);
+    bitbuf_skip_byte_padding(read);
+
+    // a fragment larger than the whole destination is treated as
+    // malformed, which keeps the offsets below from overflowing
+    if (read->read_past_end || index >= num_fragments || fragment_bytes == 0 ||
+        fragment_bytes > reasm->dest->capacity_bytes || (num_bits + 7) / 8 > fragment_bytes ||
+        !bitbuf__can_read(read, num_bits))
+        return false;
+
+    if (reasm->num_fragments == 0) {
+        reasm->message_id = message_id;
+        reasm->num_fragments = num_fragments;
+        reasm->fragment_bytes = (size_t)fragment_bytes;
+    }
+
+    offset_bytes = (size_t)index * reasm->fragment_bytes;
+    if (message_id != reasm->message_id || num_fragments != reasm->num_fragments ||
+        fragment_bytes != reasm->fragment_bytes ||
+        (reasm->received[index / 64] & (1ull << (index % 64))) ||
+        offset_bytes * 8 + num_bits > reasm->dest->capacity_bytes * 8) {
+        bitbuf_cursor_seek_bits(read, bitbuf_cursor_tell_bits(read) + (size_t)num_bits);
+        return false;
+    }
+
+    // the payload follows a padded header, so where stream bytes are in
+    // memory order, whole bytes are copied straight into place.
+    // otherwise it is written from the payload offset, as writes only
+    // or into the destination.
+    if (BITBUF__LITTLE_ENDIAN) {
+        dest_bytes = (uint8_t*)reasm->dest->data + offset_bytes;
+        bitbuf_read_bytes(read, dest_bytes, num_bits / 8);
+        if (num_bits % 8)
+            dest_bytes[num_bits / 8] = (uint8_t)bitbuf_read_n_bits(read, num_bits % 8, NULL);
+    } else {
+        uint64_t left;
+        int      n;
+
+        bitbuf__set_cursor_pos(&reasm->dest->write, reasm->dest->data, offset_bytes * 8);
+        for (left = num_bits; left > 0; left -= n) {
+            n = (int)BITBUF__MIN(left, 64);
+            bitbuf__write_bits(reasm->dest, bitbuf_read_n_bits(read, n, NULL), n);
+        }
+    }
+
+    reasm->received[index / 64] |= 1ull << (index % 64);
+    end_bits = offset_bytes * 8 + (size_t)num_bits;
+    if (index + 1 == num_fragments)
+        reasm->num_bits = end_bits;
+
+    if (++reasm->num_received == reasm->num_fragments)
+        end_bits = reasm->num_bits;
+    else
+        end_bits = BITBUF__MAX(end_bits, bitbuf_num_bits_written(reasm->dest));
+    bitbuf__set_cursor_pos(&reasm->dest->write, reasm->dest->data, end_bits);
+
+    return true;
+}
+
+BITBUFDEF bool
+bitbuf_reassembler_add(bitbuf_reassembler_t* reasm, bitbuf_cursor_t* read)
+{
+    int  past_end = bitbuf__begin_block_read(read);
+    bool added = bitbuf__reassembler_add_fragment(reasm, read);
+
+    bitbuf__end_block_read(read, past_end);
+    return added;
+}
+
+BITBUFDEF bool
+bitbuf_reassembler_is_complete(const bitbuf_reassembler_t* reasm)
+{
+    return reasm->num_fragments > 0 && reasm->num_received == reasm->num_fragments;
+}
+
+// pointer to the byte at a byte aligned cursor, or NULL if the cursor
+// is not byte aligned or stream bytes are not in memory order
+static const uint8_t*
+bitbuf__cursor_bytes(const bitbuf_cursor_t* read)
+{
+    BITBUF__ASSERT(bitbuf__is_valid_read_cursor(read));
+
+    if (!BITBUF__LITTLE_ENDIAN)
+        return NULL;
+
+    if ((read->bits_into_seg & 7) != 0) {
+        BITBUF__ASSERT_FAIL("views require a byte aligned cursor");
+        return NULL;
+    }
+
+    return (const uint8_t*)read->seg + read->bits_into_seg / 8;
+}
+
+BITBUFDEF const uint8_t*
+bitbuf_read_bytes_view(bitbuf_cursor_t* read, size_t num_bytes)
+{
+    const uint8_t* bytes = bitbuf__cursor_bytes(read);
+
+    if (!bytes || !bitbuf__can_read(read, num_bytes * 8))
+        return NULL;
+
+    bitbuf__set_cursor_pos(read,
+                           read->owner->data,
+                           bitbuf__cursor_pos(read, read->owner->data) + num_bytes * 8);
+
+    return bytes;
+}
+
+BITBUFDEF const char*
+bitbuf_read_cstr_view(bitbuf_cursor_t* read, size_t* out_len)
+{
+    const uint8_t* bytes = bitbuf__cursor_bytes(read);
+
+    if (!bytes)
+        return NULL;
+
+    size_t         avail_bytes = bitbuf__bits_remaining_for_cursor(read->owner, read) / 8;
+    const uint8_t* nul = (const uint8_t*)memchr(bytes, 0, avail_bytes);
+
+    if (!nul) {
+        BITBUF__ASSERT_FAIL("read past end of buffer");
+        read->read_past_end |= 1;
+        return NULL;
+    }
+
+    size_t len = nul - bytes;
+    if (out_len)
+        *out_len = len;
+
+    bitbuf__set_cursor_pos(read,
+                           read->owner->data,
+                           bitbuf__cursor_pos(read, read->owner->data) + (len + 1) * 8);
+
+    return (const char*)bytes;
+}
+
+BITBUFDEF void
+bitbuf_read_bytes(bitbuf_cursor_t* read, void* out_bytes, size_t num_bytes)
+{
+    uint8_t*           dst = (uint8_t*)out_bytes;
+    bitbuf__unpacker_t unpacker;
+    size_t             i;
+
+    if (num_bytes == 0)
+        return;
+    if (!bitbuf__can_read(read, num_bytes * 8)) {
+        memset(out_bytes, 0, num_bytes);
+        return;
+    }
+    if (bitbuf__copy_array_from_cursor(read, 8, out_bytes, num_bytes, 1))
+        return;
+
+    unpacker = bitbuf__unpacker_begin(read);
+    for (i = 0; i + 8 <= num_bytes; i += 8) {
+        bitbuf__store_le64(dst + i, bitbuf__unpack(&unpacker, 64));
+    }
+    for (; i < num_bytes; i++) {
+        dst[i] = (uint8_t)bitbuf__unpack(&unpacker, 8);
+    }
+    bitbuf__unpacker_end(&unpacker, read);
+}
+
+// range coder, after the lzma coder.  probabilities are the chance of
+// a 0 bit, out of 1 << BITBUF_PROB_BITS, and move 1/32 of the way
+// towards each bit coded.
+#define BITBUF__RANGE_TOP (1u << 24)
+#define BITBUF__PROB_MOVE_BITS 5
+
+BITBUFDEF void
+bitbuf_init_probs(bitbuf_prob_t* probs, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        probs[i] = BITBUF_PROB_INIT;
+    }
+}
+
+BITBUFDEF bitbuf_range_encoder_t
+bitbuf_range_encoder_begin(bitbuf_buffer_t* buf)
+{
+    bitbuf_range_encoder_t enc;
+
+    enc.buf = buf;
+    enc.low = 0;
+    enc.range = 0xffffffffu;
+    enc.cache = 0;
+    enc.cache_size = 1;
+    enc.first_byte = 1;
+
+    return enc;
+}
+
+// move the top byte of low out, once no carry can change it
+static void
+bitbuf__range_shift_low(bitbuf_range_encoder_t* enc)
+{
+    if ((uint32_t)enc->low < 0xff000000u || (enc->low >> 32) != 0) {
+        uint8_t carry = (uint8_t)(enc->low >> 32);
+        uint8_t byte = enc->cache;
+
+        do {
+            if (!enc->first_byte)
+                bitbuf_write_uint8(enc->buf, (uint8_t)(byte + carry));
+            enc->first_byte = 0;
+            byte = 0xff;
+        } while (--enc->cache_size != 0);
+
+        enc->cache = (uint8_t)(enc->low >> 24);
+    }
+
+    enc->cache_size++;
+    enc->low = (enc->low & 0x00ffffffu) << 8;
+}
+
+static BITBUF_INLINE void
+bitbuf__range_encode_normalize(bitbuf_range_encoder_t* enc)
+{
+    while (enc->range < BITBUF__RANGE_TOP) {
+        enc->range <<= 8;
+        bitbuf__range_shift_low(enc);
+    }
+}
+
+BITBUFDEF void
+bitbuf_range_encoder_end(bitbuf_range_encoder_t* enc)
+{
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        bitbuf__range_shift_low(enc);
+    }
+}
+
+BITBUFDEF void
+bitbuf_range_encode_bit(bitbuf_range_encoder_t* enc, bitbuf_prob_t* prob, int bit)
+{
+    uint32_t bound = (enc->range >> BITBUF_PROB_BITS) * *prob;
+
+    if (!bit) {
+        enc->range = bound;
+        *prob += ((1 << BITBUF_PROB_BITS) - *prob) >> BITBUF__PROB_MOVE_BITS;
+    } else {
+        enc->low += bound;
+        enc->range -= bound;
+        *prob -= *prob >> BITBUF__PROB_MOVE_BITS;
+    }
+
+    bitbuf__range_encode_normalize(enc);
+}
+
+BITBUFDEF void
+bitbuf_range_encode_symbol(bitbuf_range_encoder_t* enc,
+                           bitbuf_prob_t*          probs,
+                           int                     num_bits,
+                           uint32_t                symbol)
+{
+    // the bits coded so far, with a leading 1, index the model
+    uint32_t node = 1;
+    int      i;
+
+    BITBUF__ASSERT(num_bits >= 1 && num_bits <= 16);
+    BITBUF__ASSERT(symbol < (1u << num_bits));
+
+    for (i = num_bits - 1; i >= 0; i--) {
+        int bit = (symbol >> i) & 1;
+
+        bitbuf_range_encode_bit(enc, &probs[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+BITBUFDEF void
+bitbuf_range_encode_direct(bitbuf_range_encoder_t* enc, int num_bits, uint64_t value)
+{
+    int i;
+
+    BITBUF__ASSERT(num_bits >= 0 && num_bits <= 64);
+
+    for (i = num_bits - 1; i >= 0; i--) {
+        enc->range >>= 1;
+        if ((value >> i) & 1)
+            enc->low += enc->range;
+
+        bitbuf__range_encode_normalize(enc);
+    }
+}
+
+BITBUFDEF void
+bitbuf_range_encode_uint(bitbuf_range_encoder_t* enc, bitbuf_prob_t* probs, uint64_t value)
+{
+    int width = bitbuf__bit_width(value);
+
+    bitbuf_range_encode_symbol(enc, probs, 7, (uint32_t)width);
+    if (width > 1)
+        bitbuf_range_encode_direct(enc, width - 1, value & bitbuf__low_mask(width - 1));
+}
+
+BITBUFDEF bitbuf_range_decoder_t
+bitbuf_range_decoder_begin(bitbuf_cursor_t* read)
+{
+    bitbuf_range_decoder_t dec;
+    int                    i;
+
+    dec.read = read;
+    dec.range = 0xffffffffu;
+    dec.code = 0;
+
+    for (i = 0; i < 4; i++) {
+        dec.code = (dec.code << 8) | bitbuf_read_uint8(read);
+    }
+
+    return dec;
+}
+
+static BITBUF_INLINE void
+bitbuf__range_decode_normalize(bitbuf_range_decoder_t* dec)
+{
+    while (dec->range < BITBUF__RANGE_TOP) {
+        dec->range <<= 8;
+        dec->code = (dec->code << 8) | bitbuf_read_uint8(dec->read);
+    }
+}
+
+BITBUFDEF int
+bitbuf_range_decode_bit(bitbuf_range_decoder_t* dec, bitbuf_prob_t* prob)
+{
+    uint32_t bound = (dec->range >> BITBUF_PROB_BITS) * *prob;
+    int      bit;
+
+    if (dec->code < bound) {
+        dec->range = bound;
+        *prob += ((1 << BITBUF_PROB_BITS) - *prob) >> BITBUF__PROB_MOVE_BITS;
+        bit = 0;
+    } else {
+        dec->code -= bound;
+        dec->range -= bound;
+        *prob -= *prob >> BITBUF__PROB_MOVE_BITS;
+        bit = 1;
+    }
+
+    bitbuf__range_decode_normalize(dec);
+
+    return bit;
+}
+
+BITBUFDEF uint32_t
+bitbuf_range_decode_symbol(bitbuf_range_decoder_t* dec, bitbuf_prob_t* probs, int num_bits)
+{
+    uint32_t node = 1;
+    int      i;
+
+    BITBUF__ASSERT(num_bits >= 1 && num_bits <= 16);
+
+    for (i = 0; i < num_bits; i++) {
+        node = (node << 1) | (uint32_t)bitbuf_range_decode_bit(dec, &probs[node]);
+    }
+
+    return node - (1u << num_bits);
+}
+
+BITBUFDEF uint64_t
+bitbuf_range_decode_direct(bitbuf_range_decoder_t* dec, int num_bits)
+{
+    uint64_t value = 0;
+    int      i;
+
+    BITBUF__ASSERT(num_bits >= 0 && num_bits <= 64);
+
+    for (i = 0; i < num_bits; i++) {
+        int bit;
+
+        dec->range >>= 1;
+        bit = dec->code >= dec->range;
+        if (bit)
+            dec->code -= dec->range;
+
+        value = (value << 1) | (uint64_t)bit;
+        bitbuf__range_decode_normalize(dec);
+    }
+
+    return value;
+}
+
+BITBUFDEF uint64_t
+bitbuf_range_decode_uint(bitbuf_range_decoder_t* dec, bitbuf_prob_t* probs)
+{
+    int width = (int)bitbuf_range_decode_symbol(dec, probs, 7);
+
+    if (width > 64) {
+        BITBUF__ASSERT_FAIL("range coded uint exceeds 64 bits");
+        return 0;
+    }
+    if (width <= 1)
+        return (uint64_t)width;
+
+    return (1ull << (width - 1)) | bitbuf_range_decode_direct(dec, width - 1);
+}
+
+// rANS with 32-bit states kept in [BITBUF__RANS_L, BITBUF__RANS_L << 16),
+// renormalized 16 bits at a time, and frequencies scaled to sum to
+// 1 << BITBUF__RANS_SCALE_BITS.  a frequency is at most 4095, so a
+// decode table entry packs frequency, bias and symbol in 32 bits.
+#define BITBUF__RANS_SCALE_BITS 12
+#define BITBUF__RANS_SCALE (1u << BITBUF__RANS_SCALE_BITS)
+#define BITBUF__RANS_L (1u << 16)
+#define BITBUF__RANS_LANES 8
+
+static BITBUF_INLINE void
+bitbuf__store_le16(uint8_t* p, uint32_t word)
+{
+    p[0] = (uint8_t)word;
+    p[1] = (uint8_t)(word >> 8);
+}
+
+static BITBUF_INLINE uint32_t
+bitbuf__load_le16(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+// scale byte counts to frequencies that sum to BITBUF__RANS_SCALE,
+// keeping every present byte at least 1
+static void
+bitbuf__rans_normalize(const size_t* counts, size_t total, uint32_t* freqs)
+{
+    uint32_t sum = 0;
+    int      num_present = 0;
+    int      largest = 0;
+    int      i;
+
+    for (i = 0; i < 256; i++) {
+        freqs[i] = 0;
+        if (!counts[i])
+            continue;
+
+        freqs[i] = (uint32_t)BITBUF__MAX((double)counts[i] * BITBUF__RANS_SCALE / total, 1.0);
+        sum += freqs[i];
+        num_present++;
+        if (freqs[i] > freqs[largest])
+            largest = i;
+    }
+
+    // a lone byte would need all of the range, one past the 12 bits of
+    // a table entry.  give it a neighbour that is never coded.
+    if (num_present == 1) {
+        freqs[largest ^ 1] = 1;
+        sum++;
+    }
+
+    while (sum > BITBUF__RANS_SCALE) {
+        // take from the largest, whose relative error is smallest
+        uint32_t excess = BITBUF__MIN(sum - BITBUF__RANS_SCALE, freqs[largest] / 2);
+
+        freqs[largest] -= excess;
+        sum -= excess;
+        for (i = 0; i < 256; i++) {
+            if (freqs[i] > freqs[largest])
+                largest = i;
+        }
+    }
+    freqs[largest] += BITBUF__RANS_SCALE - sum;
+}
+
+static BITBUF_INLINE uint32_t
+bitbuf__rans_encode(uint32_t x, uint32_t freq, uint32_t cum, uint8_t** words)
+{
+    if (x >= ((BITBUF__RANS_L >> BITBUF__RANS_SCALE_BITS) << 16) * freq) {
+        *words -= 2;
+        bitbuf__store_le16(*words, x & 0xffff);
+        x >>= 16;
+    }
+
+    return ((x / freq) << BITBUF__RANS_SCALE_BITS) + (x % freq) + cum;
+}
+
+BITBUFDEF void
+bitbuf_write_rans_bytes(bitbuf_buffer_t* buf, const uint8_t* bytes, size_t count)
+{
+    size_t   counts[256] = {0};
+    uint32_t freqs[256], cums[256];
+    uint32_t states[BITBUF__RANS_LANES];
+    uint32_t cum = 0;
+    size_t   num_groups = count / BITBUF__RANS_LANES;
+    size_t   words_bytes = (count + 2 * BITBUF__RANS_LANES) * 2;
+    uint8_t* words_start;
+    uint8_t* words;
+    size_t   i;
+    int      lane;
+
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_varint_u64(buf, 7, count);
+    if (count == 0)
+        return;
+
+    for (i = 0; i < count; i++) {
+        counts[bytes[i]]++;
+    }
+    bitbuf__rans_normalize(counts, count, freqs);
+
+    for (i = 0; i < 256; i += 64) {
+        uint64_t present = 0;
+        int      bit;
+
+        for (bit = 0; bit < 64; bit++) {
+            present |= (uint64_t)(freqs[i + bit] != 0) << bit;
+        }
+        bitbuf_write_uint64(buf, present);
+    }
+    for (i = 0; i < 256; i++) {
+        cums[i] = cum;
+        cum += freqs[i];
+        if (freqs[i])
+            bitbuf_write_n_bits(buf, BITBUF__RANS_SCALE_BITS, freqs[i] - 1);
+    }
+
+    // encode backwards, so the decoder reads the words forwards.  the
+    // tail that does not fill all lanes is decoded last, so it is
+    // encoded first.
+    words_start = (uint8_t*)BITBUF_MALLOC(words_bytes);
+    words = words_start + words_bytes;
+
+    for (lane = 0; lane < BITBUF__RANS_LANES; lane++) {
+        states[lane] = BITBUF__RANS_L;
+    }
+    for (i = count; i > num_groups * BITBUF__RANS_LANES; i--) {
+        uint8_t sym = bytes[i - 1];
+        lane = (int)((i - 1) % BITBUF__RANS_LANES);
+        states[lane] = bitbuf__rans_encode(states[lane], freqs[sym], cums[sym], &words);
+    }
+    for (i = num_groups; i > 0; i--) {
+        const uint8_t* group = bytes + (i - 1) * BITBUF__RANS_LANES;
+
+        for (lane = BITBUF__RANS_LANES - 1; lane >= 0; lane--) {
+            uint8_t sym = group[lane];
+            states[lane] = bitbuf__rans_encode(states[lane], freqs[sym], cums[sym], &words);
+        }
+    }
+    for (lane = BITBUF__RANS_LANES - 1; lane >= 0; lane--) {
+        words -= 4;
+        bitbuf__store_le16(words, states[lane] & 0xffff);
+        bitbuf__store_le16(words + 2, states[lane] >> 16);
+    }
+
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_varint_u64(buf, 7, (uint64_t)(words_start + words_bytes - words) / 2);
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_bytes(buf, words, (size_t)(words_start + words_bytes - words));
+
+    BITBUF_FREE(words_start);
+}
+
+// decode table entries: frequency in bits 0-11, the offset of the slot
+// into the symbol's range in bits 12-23, the symbol in bits 24-31
+static BITBUF_INLINE uint32_t
+bitbuf__rans_decode(uint32_t x, const uint32_t* table, uint8_t* out)
+{
+    uint32_t entry = table[x & (BITBUF__RANS_SCALE - 1)];
+
+    *out = (uint8_t)(entry >> 24);
+    return (entry & 0xfff) * (x >> BITBUF__RANS_SCALE_BITS) + ((entry >> 12) & 0xfff);
+}
+
+// returns false if the words run out, which only a corrupt block does
+static BITBUF_INLINE bool
+bitbuf__rans_renorm(uint32_t* x, const uint8_t** words, const uint8_t* end)
+{
+    if (*x >= BITBUF__RANS_L)
+        return true;
+    if (end - *words < 2)
+        return false;
+
+    *x = (*x << 16) | bitbuf__load_le16(*words);
+    *words += 2;
+    return true;
+}
+
+#ifdef BITBUF__SSE41
+/* clang-format off */
+// pshufb controls moving the next 16-bit words into the lanes that
+// need them, indexed by the mask of those lanes
+static const int8_t bitbuf__rans_refill_shuffles[16][16] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {0, 1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1},
+    {0, 1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, 0, 1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1},
+    {0, 1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1},
+    {0, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1},
+    {-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1},
+    {0, 1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, -1, 2, 3, -1, -1},
+    {0, 1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1},
+    {-1, -1, -1, -1, 0, 1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1},
+    {0, 1, -1, -1, 2, 3, -1, -1, 4, 5, -1, -1, 6, 7, -1, -1},
+};
+/* clang-format on */
+
+// decode four lanes, storing their symbols to out, and refill the
+// lanes that fell below BITBUF__RANS_L
+static BITBUF_INLINE __m128i
+bitbuf__rans_decode4(__m128i x, const uint32_t* table, uint8_t* out, const uint8_t** words)
+{
+    const __m128i low12 = _mm_set1_epi32(0xfff);
+    const __m128i flip = _mm_set1_epi32((int)0x80000000u);
+    __m128i       slot = _mm_and_si128(x, low12);
+    __m128i       entry, under, refill;
+    int32_t       symbols;
+    int           mask;
+
+    entry = _mm_setr_epi32((int)table[_mm_cvtsi128_si32(slot)],
+                           (int)table[_mm_extract_epi32(slot, 1)],
+                           (int)table[_mm_extract_epi32(slot, 2)],
+                           (int)table[_mm_extract_epi32(slot, 3)]);
+
+    x = _mm_add_epi32(_mm_mullo_epi32(_mm_and_si128(entry, low12), _mm_srli_epi32(x, 12)),
+                      _mm_and_si128(_mm_srli_epi32(entry, 12), low12));
+
+    // symbols to the low 4 bytes
+    entry = _mm_srli_epi32(entry, 24);
+    entry = _mm_packus_epi16(_mm_packus_epi32(entry, entry), entry);
+    symbols = _mm_cvtsi128_si32(entry);
+    memcpy(out, &symbols, sizeof(symbols));
+
+    // unsigned compare, by flipping the sign bits
+    under = _mm_cmplt_epi32(_mm_xor_si128(x, flip),
+                            _mm_set1_epi32((int)(BITBUF__RANS_L ^ 0x80000000u)));
+    mask = _mm_movemask_ps(_mm_castsi128_ps(under));
+
+    refill = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)*words),
+                              _mm_loadu_si128((const __m128i*)bitbuf__rans_refill_shuffles[mask]));
+    x = _mm_blendv_epi8(x, _mm_or_si128(_mm_slli_epi32(x, 16), refill), under);
+
+    // popcount of the 4-bit mask, as a nibble table
+    *words += 2 * ((0x4332322132212110ull >> (mask * 4)) & 0xf);
+
+    return x;
+}
+#endif
+
+static size_t
+bitbuf__rans_corrupt(bitbuf_cursor_t* read)
+{
+    BITBUF__ASSERT_FAIL("corrupt or oversized rans block");
+    read->read_past_end |= 1;
+
+    return 0;
+}
+
+static size_t
+bitbuf__read_rans_block(bitbuf_cursor_t* read, uint8_t* out_bytes, size_t max_count)
+{
+    uint32_t       freqs[256];
+    uint32_t       states[BITBUF__RANS_LANES];
+    uint32_t       cum = 0;
+    uint32_t*      table;
+    uint8_t*       words_copy = NULL;
+    const uint8_t* words;
+    const uint8_t* words_end;
+    size_t         count, num_words, num_groups, group = 0, i;
+    bool           ok = true;
+    int            lane;
+
+    bitbuf_skip_byte_padding(read);
+    count = (size_t)bitbuf_read_varint_u64(read, 7);
+    if (read->read_past_end || count > max_count)
+        return bitbuf__rans_corrupt(read);
+    if (count == 0)
+        return 0;
+
+    for (i = 0; i < 256; i += 64) {
+        uint64_t present = bitbuf_read_uint64(read);
+        int      bit;
+
+        for (bit = 0; bit < 64; bit++) {
+            freqs[i + bit] = (present >> bit) & 1;
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        if (freqs[i])
+            freqs[i] += (uint32_t)bitbuf_read_n_bits(read, BITBUF__RANS_SCALE_BITS, NULL);
+        cum += freqs[i];
+    }
+
+    bitbuf_skip_byte_padding(read);
+    num_words = (size_t)bitbuf_read_varint_u64(read, 7);
+    bitbuf_skip_byte_padding(read);
+    if (read->read_past_end || cum != BITBUF__RANS_SCALE || num_words < 2 * BITBUF__RANS_LANES ||
+        num_words > count + 2 * BITBUF__RANS_LANES)
+        return bitbuf__rans_corrupt(read);
+
+    // words are read in place where the stream bytes are in memory order
+    words = bitbuf_read_bytes_view(read, num_words * 2);
+    if (!words && !read->read_past_end) {
+        words_copy = (uint8_t*)BITBUF_MALLOC(num_words * 2);
+        bitbuf_read_bytes(read, words_copy, num_words * 2);
+        words = words_copy;
+    }
+    if (read->read_past_end) {
+        if (words_copy)
+            BITBUF_FREE(words_copy);
+        return bitbuf__rans_corrupt(read);
+    }
+    words_end = words + num_words * 2;
+
+    table = (uint32_t*)BITBUF_MALLOC(BITBUF__RANS_SCALE * sizeof(uint32_t));
+    for (i = 0, cum = 0; i < 256; i++) {
+        uint32_t slot;
+
+        for (slot = 0; slot < freqs[i]; slot++) {
+            table[cum + slot] = freqs[i] | (slot << 12) | ((uint32_t)i << 24);
+        }
+        cum += freqs[i];
+    }
+
+    for (lane = 0; lane < BITBUF__RANS_LANES; lane++) {
+        states[lane] = bitbuf__load_le16(words) | (bitbuf__load_le16(words + 2) << 16);
+        words += 4;
+    }
+
+    num_groups = count / BITBUF__RANS_LANES;
+
+#ifdef BITBUF__SSE41
+    {
+        __m128i x0 = _mm_loadu_si128((const __m128i*)states);
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(states + 4));
+
+        // each group takes at most 16 bytes of words
+        for (; group < num_groups && words_end - words >= 16; group++) {
+            uint8_t* out = out_bytes + group * BITBUF__RANS_LANES;
+
+            x0 = bitbuf__rans_decode4(x0, table, out, &words);
+            x1 = bitbuf__rans_decode4(x1, table, out + 4, &words);
+        }
+
+        _mm_storeu_si128((__m128i*)states, x0);
+        _mm_storeu_si128((__m128i*)(states + 4), x1);
+    }
+#endif
+
+    for (; group < num_groups; group++) {
+        uint8_t* out = out_bytes + group * BITBUF__RANS_LANES;
+
+        for (lane = 0; lane < BITBUF__RANS_LANES; lane++) {
+            states[lane] = bitbuf__rans_decode(states[lane], table, out + lane);
+        }
+        for (lane = 0; lane < BITBUF__RANS_LANES; lane++) {
+            ok &= bitbuf__rans_renorm(&states[lane], &words, words_end);
+        }
+    }
+    for (i = num_groups * BITBUF__RANS_LANES; i < count; i++) {
+        lane = (int)(i % BITBUF__RANS_LANES);
+        states[lane] = bitbuf__rans_decode(states[lane], table, out_bytes + i);
+        ok &= bitbuf__rans_renorm(&states[lane], &words, words_end);
+    }
+
+    // every lane ends where the encoder started it, with every word used
+    for (lane = 0; lane < BITBUF__RANS_LANES; lane++) {
+        ok &= states[lane] == BITBUF__RANS_L;
+    }
+    ok &= words == words_end;
+
+    BITBUF_FREE(table);
+    if (words_copy)
+        BITBUF_FREE(words_copy);
+
+    return ok ? count : bitbuf__rans_corrupt(read);
+}
+
+BITBUFDEF size_t
+bitbuf_read_rans_bytes(bitbuf_cursor_t* read, uint8_t* out_bytes, size_t max_count)
+{
+    int    past_end = bitbuf__begin_block_read(read);
+    size_t count = bitbuf__read_rans_block(read, out_bytes, max_count);
+
+    bitbuf__end_block_read(read, past_end);
+    return count;
+}
+
+// elias-fano counts and high parts are varints of 7-bit groups
+#define BITBUF__EF_VARINT_BITS 7
+
+BITBUFDEF void
+bitbuf_write_elias_fano(bitbuf_buffer_t* buf, const uint64_t* values, size_t count)
+{
+    bitbuf__packer_t packer;
+    size_t           i;
+
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) {
+            BITBUF__ASSERT_FAIL("elias-fano values must be non-decreasing");
+            count = 0;
+            break;
+        }
+    }
+
+    bitbuf_write_varint_u64(buf, BITBUF__EF_VARINT_BITS, count);
+    if (count == 0)
+        return;
+
+    // low bits of about log2 of the average gap leave high parts that
+    // grow by about 1 per value
+    uint64_t spacing = values[count - 1] / count;
+    int      low_bits = spacing ? bitbuf__bit_width(spacing) - 1 : 0;
+    uint64_t low_mask = bitbuf__low_mask(low_bits);
+    uint64_t max_high = values[count - 1] >> low_bits;
+    size_t   high_len = (size_t)max_high + count;
+
+    bitbuf__write_bits(buf, (uint64_t)low_bits, 6);
+    bitbuf_write_varint_u64(buf, BITBUF__EF_VARINT_BITS, max_high);
+
+    if (!bitbuf__reserve(buf, count * low_bits + high_len))
+        return;
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < count; i++) {
+        bitbuf__pack(&packer, low_bits, values[i] & low_mask);
+    }
+
+    // value i sets high bit (values[i] >> low_bits) + i
+    uint64_t word = 0;
+    size_t   word_pos = 0;
+
+    for (i = 0; i < count; i++) {
+        size_t pos = (size_t)(values[i] >> low_bits) + i;
+
+        while (pos - word_pos >= 64) {
+            bitbuf__pack(&packer, 64, word);
+            word = 0;
+            word_pos += 64;
+        }
+        word |= 1ull << (pos - word_pos);
+    }
+    bitbuf__pack(&packer, (int)(high_len - word_pos), word);
+
+    bitbuf__packer_end(&packer, buf);
+}
+
+// 64 high bits from pos, zero past their end
+static uint64_t
+bitbuf__ef_high_word(const bitbuf_elias_fano_t* ef, size_t pos)
+{
+    bitbuf_cursor_t at = bitbuf__cursor_for(ef->owner);
+
+    if (pos >= ef->high_len)
+        return 0;
+
+    bitbuf__set_cursor_pos(&at, ef->owner->data, ef->high_pos + pos);
+    return bitbuf_peek_n_bits(&at, (int)BITBUF__MIN(ef->high_len - pos, 64));
+}
+
+static uint64_t
+bitbuf__ef_value(const bitbuf_elias_fano_t* ef, size_t index, size_t high_pos)
+{
+    bitbuf_cursor_t at = bitbuf__cursor_for(ef->owner);
+
+    bitbuf__set_cursor_pos(&at, ef->owner->data, ef->low_pos + index * ef->low_bits);
+
+    return ((uint64_t)(high_pos - index) << ef->low_bits) |
+           bitbuf_peek_n_bits(&at, ef->low_bits);
+}
+
+static bitbuf_elias_fano_t
+bitbuf__read_elias_fano_block(bitbuf_cursor_t* read)
+{
+    bitbuf_elias_fano_t ef;
+
+    memset(&ef, 0, sizeof(ef));
+    ef.owner = read->owner;
+
+    uint64_t count = bitbuf_read_varint_u64(read, BITBUF__EF_VARINT_BITS);
+    if (read->read_past_end || count == 0)
+        return ef;
+
+    int      low_bits = (int)bitbuf__read_bits(read, 6);
+    uint64_t max_high = bitbuf_read_varint_u64(read, BITBUF__EF_VARINT_BITS);
+    if (read->read_past_end)
+        return ef;
+
+    // both parts must be in the buffer
+    ptrdiff_t remaining = bitbuf__bits_remaining_for_cursor(read->owner, read);
+    uint64_t  avail = remaining > 0 ? (uint64_t)remaining : 0;
+
+    if (count > avail || max_high > avail - count ||
+        count * (uint64_t)low_bits > avail - count - max_high) {
+        BITBUF__ASSERT_FAIL("elias-fano block runs past end of buffer");
+        read->read_past_end |= 1;
+        return ef;
+    }
+
+    size_t pos = bitbuf__cursor_pos(read, read->owner->data);
+
+    ef.count = (size_t)count;
+    ef.low_bits = low_bits;
+    ef.low_pos = pos;
+    ef.high_pos = pos + ef.count * low_bits;
+    ef.high_len = (size_t)max_high + ef.count;
+    ef.word = bitbuf__ef_high_word(&ef, 0);
+
+    bitbuf__set_cursor_pos(read, read->owner->data, ef.high_pos + ef.high_len);
+
+    return ef;
+}
+
+BITBUFDEF bitbuf_elias_fano_t
+bitbuf_read_elias_fano(bitbuf_cursor_t* read)
+{
+    int                 past_end = bitbuf__begin_block_read(read);
+    bitbuf_elias_fano_t ef = bitbuf__read_elias_fano_block(read);
+
+    bitbuf__end_block_read(read, past_end);
+    return ef;
+}
+
+BITBUFDEF bool
+bitbuf_elias_fano_next(bitbuf_elias_fano_t* ef, uint64_t* out_value)
+{
+    if (ef->index >= ef->count)
+        return false;
+
+    while (ef->word == 0) {
+        // every set bit before the next word is a returned value
+        ef->word_pos += 64;
+        ef->ones_before = ef->index;
+
+        // malformed: fewer set high bits than values
+        if (ef->word_pos >= ef->high_len) {
+            ef->index = ef->count;
+            return false;
+        }
+
+        ef->word = bitbuf__ef_high_word(ef, ef->word_pos);
+    }
+
+    size_t high_pos = ef->word_pos + bitbuf__ctz64(ef->word);
+
+    ef->word &= ef->word - 1;
+    *out_value = bitbuf__ef_value(ef, ef->index, high_pos);
+    ef->index++;
+
+    return true;
+}
+
+BITBUFDEF bool
+bitbuf_elias_fano_next_geq(bitbuf_elias_fano_t* ef, uint64_t target, uint64_t* out_value)
+{
+    uint64_t bucket = target >> ef->low_bits;
+
+    // values with a high part of bucket or more follow the bucket'th
+    // zero of the high bits.  unless it is behind word_pos, find it,
+    // counting whole words by popcount.
+    if (ef->index < ef->count && bucket > ef->word_pos - ef->ones_before) {
+        size_t   word_pos = ef->word_pos;
+        size_t   ones = ef->ones_before;
+        size_t   zeros = word_pos - ones;
+        uint64_t word = bitbuf__ef_high_word(ef, word_pos);
+
+        for (;;) {
+            size_t word_bits = BITBUF__MIN(ef->high_len - word_pos, 64);
+            int    word_ones = bitbuf__popcount64(word);
+
+            if (zeros + (word_bits - word_ones) >= bucket)
+                break;
+
+            zeros += word_bits - word_ones;
+            ones += word_ones;
+            word_pos += 64;
+
+            // past the largest value
+            if (word_pos >= ef->high_len) {
+                ef->index = ef->count;
+                return false;
+            }
+
+            word = bitbuf__ef_high_word(ef, word_pos);
+        }
+
+        int    zero_bit = bitbuf__select64(~word, (int)(bucket - zeros - 1));
+        size_t start_index = word_pos + zero_bit + 1 - (size_t)bucket;
+
+        if (start_index > ef->index) {
+            ef->index = start_index;
+            ef->word_pos = word_pos;
+            ef->ones_before = ones;
+            ef->word = word & ~bitbuf__low_mask(zero_bit + 1);
+        }
+    }
+
+    while (bitbuf_elias_fano_next(ef, out_value)) {
+        if (*out_value >= target)
+            return true;
+    }
+
+    return false;
+}
+
+BITBUFDEF uint64_t
+bitbuf_elias_fano_get(const bitbuf_elias_fano_t* ef, size_t index)
+{
+    size_t   word_pos = 0;
+    size_t   ones = 0;
+    uint64_t word;
+    int      word_ones;
+
+    if (index >= ef->count) {
+        BITBUF__ASSERT_FAIL("elias-fano index out of range");
+        return 0;
+    }
+
+    word = bitbuf__ef_high_word(ef, 0);
+    while (ones + (word_ones = bitbuf__popcount64(word)) <= index) {
+        ones += word_ones;
+        word_pos += 64;
+
+        // malformed: fewer set high bits than values
+        if (word_pos >= ef->high_len)
+            return 0;
+
+        word = bitbuf__ef_high_word(ef, word_pos);
+    }
+
+    return bitbuf__ef_value(ef, index, word_pos + bitbuf__select64(word, (int)(index - ones)));
+}
+
+// a pfor block is BITBUF__PFOR_SLOTS values in each of 4 lanes
+#define BITBUF__PFOR_SLOTS (BITBUF_PFOR_BLOCK / 4)
+
+// block header: 32-bit minimum, then 8 bits each of width, exception
+// count and exception high bits
+#define BITBUF__PFOR_HEADER_BITS 56
+
+static void
+bitbuf__write_pfor_block(bitbuf_buffer_t* buf, const uint32_t* values)
+{
+    uint32_t         deltas[BITBUF_PFOR_BLOCK];
+    uint32_t         words[BITBUF_PFOR_BLOCK];
+    uint8_t          indexes[BITBUF_PFOR_BLOCK];
+    int              hist[4][33] = {{0}};
+    uint32_t         min = values[0], mask;
+    int              max_width = 32, width, cost, exceptions = 0, exception_bits, i, lane;
+    bitbuf__packer_t packer;
+
+    for (i = 1; i < BITBUF_PFOR_BLOCK; i++) {
+        min = BITBUF__MIN(min, values[i]);
+    }
+
+    // four histograms, so that runs of one width do not serialize on a
+    // single counter
+    for (i = 0; i < BITBUF_PFOR_BLOCK; i++) {
+        deltas[i] = values[i] - min;
+        hist[i & 3][bitbuf__bit_width(deltas[i])]++;
+    }
+    for (i = 0; i <= 32; i++) {
+        hist[0][i] += hist[1][i] + hist[2][i] + hist[3][i];
+    }
+    while (max_width > 0 && hist[0][max_width] == 0) {
+        max_width--;
+    }
+
+    // each exception costs an 8-bit index and its bits above width
+    width = max_width;
+    cost = BITBUF_PFOR_BLOCK * max_width;
+    for (i = max_width - 1; i >= 0; i--) {
+        exceptions += hist[0][i + 1];
+        if (BITBUF_PFOR_BLOCK * i + exceptions * (8 + max_width - i) < cost) {
+            cost = BITBUF_PFOR_BLOCK * i + exceptions * (8 + max_width - i);
+            width = i;
+        }
+    }
+
+    mask = (uint32_t)bitbuf__low_mask(width);
+    exception_bits = max_width - width;
+    exceptions = 0;
+    for (i = 0; i < BITBUF_PFOR_BLOCK; i++) {
+        indexes[exceptions] = (uint8_t)i;
+        exceptions += deltas[i] > mask;
+    }
+
+    bitbuf__write_bits(buf,
+                       min | ((uint64_t)width << 32) | ((uint64_t)exceptions << 40) |
+                           ((uint64_t)exception_bits << 48),
+                       BITBUF__PFOR_HEADER_BITS);
+
+    if (!bitbuf__reserve(buf, (size_t)BITBUF_PFOR_BLOCK * width +
+                                  (size_t)exceptions * (8 + exception_bits)))
+        return;
+
+    // lane l of row r is the 32-bit word r * 4 + l.  each lane packs the
+    // differences of values l, l + 4, l + 8 ... least significant first.
+    if (width == 32) {
+        memcpy(words, deltas, sizeof(words));
+    } else if (width > 0) {
+        uint32_t row[4] = {0, 0, 0, 0};
+        int      shift = 0, num_rows = 0, slot;
+
+        for (slot = 0; slot < BITBUF__PFOR_SLOTS; slot++) {
+            const uint32_t* in = deltas + slot * 4;
+
+            for (lane = 0; lane < 4; lane++) {
+                row[lane] |= (in[lane] & mask) << shift;
+            }
+
+            shift += width;
+            if (shift >= 32) {
+                // start the next row with the bits that did not fit
+                shift -= 32;
+                for (lane = 0; lane < 4; lane++) {
+                    words[num_rows * 4 + lane] = row[lane];
+                    row[lane] = (in[lane] & mask) >> (width - shift);
+                }
+                num_rows++;
+            }
+        }
+    }
+
+    packer = bitbuf__packer_begin(buf);
+    for (i = 0; i < width * 4; i += 2) {
+        bitbuf__pack(&packer, 64, words[i] | ((uint64_t)words[i + 1] << 32));
+    }
+    for (i = 0; i < exceptions; i++) {
+        bitbuf__pack(&packer, 8, indexes[i]);
+    }
+    for (i = 0; i < exceptions; i++) {
+        bitbuf__pack(&packer, exception_bits, deltas[indexes[i]] >> width);
+    }
+    bitbuf__packer_end(&packer, buf);
+
+    bitbuf_pad_to_byte(buf);
+}
+
+BITBUFDEF void
+bitbuf_write_pfor_u32(bitbuf_buffer_t* buf, const uint32_t* values, size_t count)
+{
+    uint32_t block[BITBUF_PFOR_BLOCK];
+    size_t   i, j;
+
+    // 7-bit groups keep the count a whole number of bytes
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_varint_u64(buf, 7, count);
+
+    for (i = 0; i + BITBUF_PFOR_BLOCK <= count; i += BITBUF_PFOR_BLOCK) {
+        bitbuf__write_pfor_block(buf, values + i);
+    }
+
+    if (i < count) {
+        // pad the final block with a value already in it, costing no width
+        memcpy(block, values + i, (count - i) * sizeof(uint32_t));
+        for (j = count - i; j < BITBUF_PFOR_BLOCK; j++) {
+            block[j] = values[i];
+        }
+        bitbuf__write_pfor_block(buf, block);
+    }
+}
+
+static BITBUF_INLINE uint32_t
+bitbuf__load_le32(const uint8_t* p)
+{
+    return bitbuf__load_le16(p) | (bitbuf__load_le16(p + 2) << 16);
+}
+
+// unpack the width (1..31) bit differences of a block, adding base.
+// forced inline into a function per width and fully unrolled, so
+// shifts, masks and row loads are constants.
+#if defined(__GNUC__) || defined(__clang__)
+#    define BITBUF__PFOR_UNROLL _Pragma("GCC unroll 32")
+#else
+#    define BITBUF__PFOR_UNROLL
+#endif
+
+static BITBUF__FORCEINLINE void
+bitbuf__pfor_unpack_lanes(const uint8_t* in, uint32_t* out, uint32_t base, int width)
+{
+#if defined(BITBUF__SSE2)
+    const __m128i MASK = _mm_set1_epi32((int)bitbuf__low_mask(width));
+    const __m128i BASE = _mm_set1_epi32((int)base);
+    __m128i       row = _mm_loadu_si128((const __m128i*)in);
+    int           shift = 0, slot;
+
+    BITBUF__PFOR_UNROLL
+    for (slot = 0; slot < BITBUF__PFOR_SLOTS; slot++) {
+        __m128i value = _mm_srl_epi32(row, _mm_cvtsi32_si128(shift));
+
+        shift += width;
+        if (shift >= 32 && slot < BITBUF__PFOR_SLOTS - 1) {
+            // the rest of the value starts the next row
+            shift -= 32;
+            in += 16;
+            row = _mm_loadu_si128((const __m128i*)in);
+            value = _mm_or_si128(value, _mm_sll_epi32(row, _mm_cvtsi32_si128(width - shift)));
+        }
+
+        value = _mm_add_epi32(_mm_and_si128(value, MASK), BASE);
+        _mm_storeu_si128((__m128i*)(out + slot * 4), value);
+    }
+#else
+    const uint32_t MASK = (uint32_t)bitbuf__low_mask(width);
+    int            lane, slot;
+
+    for (lane = 0; lane < 4; lane++) {
+        const uint8_t* word = in + lane * 4;
+        uint64_t       accum = bitbuf__load_le32(word);
+        int            accum_bits = 32;
+
+        BITBUF__PFOR_UNROLL
+        for (slot = 0; slot < BITBUF__PFOR_SLOTS; slot++) {
+            if (accum_bits < width) {
+                word += 16;
+                accum |= (uint64_t)bitbuf__load_le32(word) << accum_bits;
+                accum_bits += 32;
+            }
+
+            out[slot * 4 + lane] = base + ((uint32_t)accum & MASK);
+            accum >>= width;
+            accum_bits -= width;
+        }
+    }
+#endif
+}
+
+typedef void (*bitbuf__pfor_unpack_fn)(const uint8_t* in, uint32_t* out, uint32_t base);
+
+#define BITBUF__PFOR_UNPACK(w)                                                                  \
+    static void bitbuf__pfor_unpack_##w(const uint8_t* in, uint32_t* out, uint32_t base)        \
+    {                                                                                           \
+        bitbuf__pfor_unpack_lanes(in, out, base, w);                                            \
+    }
+
+/* clang-format off */
+BITBUF__PFOR_UNPACK(1)  BITBUF__PFOR_UNPACK(2)  BITBUF__PFOR_UNPACK(3)  BITBUF__PFOR_UNPACK(4)
+BITBUF__PFOR_UNPACK(5)  BITBUF__PFOR_UNPACK(6)  BITBUF__PFOR_UNPACK(7)  BITBUF__PFOR_UNPACK(8)
+BITBUF__PFOR_UNPACK(9)  BITBUF__PFOR_UNPACK(10) BITBUF__PFOR_UNPACK(11) BITBUF__PFOR_UNPACK(12)
+BITBUF__PFOR_UNPACK(13) BITBUF__PFOR_UNPACK(14) BITBUF__PFOR_UNPACK(15) BITBUF__PFOR_UNPACK(16)
+BITBUF__PFOR_UNPACK(17) BITBUF__PFOR_UNPACK(18) BITBUF__PFOR_UNPACK(19) BITBUF__PFOR_UNPACK(20)
+BITBUF__PFOR_UNPACK(21) BITBUF__PFOR_UNPACK(22) BITBUF__PFOR_UNPACK(23) BITBUF__PFOR_UNPACK(24)
+BITBUF__PFOR_UNPACK(25) BITBUF__PFOR_UNPACK(26) BITBUF__PFOR_UNPACK(27) BITBUF__PFOR_UNPACK(28)
+BITBUF__PFOR_UNPACK(29) BITBUF__PFOR_UNPACK(30) BITBUF__PFOR_UNPACK(31)
+
+static const bitbuf__pfor_unpack_fn bitbuf__pfor_unpack_table[32] = {
+    NULL,                    bitbuf__pfor_unpack_1,  bitbuf__pfor_unpack_2,  bitbuf__pfor_unpack_3,
+    bitbuf__pfor_unpack_4,   bitbuf__pfor_unpack_5,  bitbuf__pfor_unpack_6,  bitbuf__pfor_unpack_7,
+    bitbuf__pfor_unpack_8,   bitbuf__pfor_unpack_9,  bitbuf__pfor_unpack_10, bitbuf__pfor_unpack_11,
+    bitbuf__pfor_unpack_12,  bitbuf__pfor_unpack_13, bitbuf__pfor_unpack_14, bitbuf__pfor_unpack_15,
+    bitbuf__pfor_unpack_16,  bitbuf__pfor_unpack_17, bitbuf__pfor_unpack_18, bitbuf__pfor_unpack_19,
+    bitbuf__pfor_unpack_20,  bitbuf__pfor_unpack_21, bitbuf__pfor_unpack_22, bitbuf__pfor_unpack_23,
+    bitbuf__pfor_unpack_24,  bitbuf__pfor_unpack_25, bitbuf__pfor_unpack_26, bitbuf__pfor_unpack_27,
+    bitbuf__pfor_unpack_28,  bitbuf__pfor_unpack_29, bitbuf__pfor_unpack_30, bitbuf__pfor_unpack_31,
+};
+/* clang-format on */
+
+// decode one block into out, which has room for BITBUF_PFOR_BLOCK
+// values.  returns false if the block is corrupt.
+static bool
+bitbuf__read_pfor_block(bitbuf_cursor_t* read, uint32_t* out)
+{
+    uint8_t          packed_copy[16 * 32];
+    uint8_t          indexes[BITBUF_PFOR_BLOCK];
+    const uint8_t*   packed;
+    bitbuf__unpacker_t unpacker;
+    int              i;
+
+    uint64_t header = bitbuf__read_bits(read, BITBUF__PFOR_HEADER_BITS);
+    uint32_t min = (uint32_t)header;
+    int      width = (int)(header >> 32) & 0xff;
+    int      exceptions = (int)(header >> 40) & 0xff;
+    int      exception_bits = (int)(header >> 48) & 0xff;
+
+    if (read->read_past_end || width + exception_bits > 32 || exceptions > BITBUF_PFOR_BLOCK ||
+        (exceptions > 0 && exception_bits == 0))
+        return false;
+
+    // differences are read in place where the stream bytes are in
+    // memory order
+    packed = bitbuf_read_bytes_view(read, (size_t)width * 16);
+    if (!packed && !read->read_past_end) {
+        bitbuf_read_bytes(read, packed_copy, (size_t)width * 16);
+        packed = packed_copy;
+    }
+    if (read->read_past_end)
+        return false;
+
+    if (width == 0) {
+        for (i = 0; i < BITBUF_PFOR_BLOCK; i++) {
+            out[i] = min;
+        }
+    } else if (width == 32) {
+        for (i = 0; i < BITBUF_PFOR_BLOCK; i++) {
+            out[i] = min + bitbuf__load_le32(packed + i * 4);
+        }
+    } else {
+        bitbuf__pfor_unpack_table[width](packed, out, min);
+    }
+
+    if (exceptions > 0) {
+        if (!bitbuf__can_read(read, (size_t)exceptions * (8 + exception_bits)))
+            return false;
+
+        unpacker = bitbuf__unpacker_begin(read);
+        for (i = 0; i < exceptions; i++) {
+            indexes[i] = (uint8_t)bitbuf__unpack(&unpacker, 8);
+            if (indexes[i] >= BITBUF_PFOR_BLOCK)
+                return false;
+        }
+        for (i = 0; i < exceptions; i++) {
+            out[indexes[i]] += (uint32_t)bitbuf__unpack(&unpacker, exception_bits) << width;
+        }
+        bitbuf__unpacker_end(&unpacker, read);
+    }
+
+    bitbuf_skip_byte_padding(read);
+
+    return true;
+}
+
+static size_t
+bitbuf__pfor_corrupt(bitbuf_cursor_t* read)
+{
+    BITBUF__ASSERT_FAIL("corrupt or oversized pfor array");
+    read->read_past_end |= 1;
+
+    return 0;
+}
+
+static size_t
+bitbuf__read_pfor_array(bitbuf_cursor_t* read, uint32_t* out_values, size_t max_count)
+{
+    uint32_t block[BITBUF_PFOR_BLOCK];
+    size_t   count, i;
+
+    bitbuf_skip_byte_padding(read);
+    count = (size_t)bitbuf_read_varint_u64(read, 7);
+    if (read->read_past_end || count > max_count)
+        return bitbuf__pfor_corrupt(read);
+
+    for (i = 0; i + BITBUF_PFOR_BLOCK <= count; i += BITBUF_PFOR_BLOCK) {
+        if (!bitbuf__read_pfor_block(read, out_values + i))
+            return bitbuf__pfor_corrupt(read);
+    }
+
+    if (i < count) {
+        if (!bitbuf__read_pfor_block(read, block))
+            return bitbuf__pfor_corrupt(read);
+        memcpy(out_values + i, block, (count - i) * sizeof(uint32_t));
+    }
+
+    return count;
+}
+
+BITBUFDEF size_t
+bitbuf_read_pfor_u32(bitbuf_cursor_t* read, uint32_t* out_values, size_t max_count)
+{
+    int    past_end = bitbuf__begin_block_read(read);
+    size_t count = bitbuf__read_pfor_array(read, out_values, max_count);
+
+    bitbuf__end_block_read(read, past_end);
+    return count;
+}
+
+// tests follow -- this is intended to be ran by a core developer
+// who includes ftg_test.h, a test harness.
+#ifdef FTGT_TESTS_ENABLED
+
+struct bitbuf_testvars_s {
+    bitbuf_buffer_t buf;
+};
+
+static struct bitbuf_testvars_s bitbuf__tv;
+
+static int
+bitbuf__test_setup(void)
+{
+    bitbuf__tv.buf = bitbuf_alloc_buffer(256);
+    return 0; /* setup success */
+}
+
+static int
+bitbuf__test_teardown(void)
+{
+    bitbuf_free_buffer(&bitbuf__tv.buf);
+    return 0;
+}
+
+static int
+bitbuf__test_basic(void)
+{
+    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+
+    // writes
+    bitbuf_write_bool(buf, true);
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_int64(buf, -32);
+    bitbuf_write_cstr(buf, "hello, world");
+    bitbuf_write_float(buf, -325.32f);
+    bitbuf_write_n_bits(buf, 4, 13);
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_n_bits(buf, 7, 121);
+
+    // reads
+    bitbuf_cursor_t read = bitbuf_cursor_init(buf);
+
+    TEST(bitbuf_read_bool(&read) == true);
+    bitbuf_skip_byte_padding(&read);
+    TEST(bitbuf_read_int64(&read) == -32);
+
+    char            str[256];
+    bitbuf_cursor_t read2 = read;
+    bitbuf_read_cstr(&read, 256, str);
+    TEST(strcmp(str, "hello, world") == 0);
+
+    // no room for null terminator
+    bitbuf_read_cstr(&read2, strlen("hello, world"), str);
+    TEST(str[0] == '\0');
+
+    TEST(bitbuf_read_float(&read) == -325.32f);
+
+    uint64_t mask;
+    TEST(bitbuf_read_n_bits(&read, 4, &mask) == 13);
+    TEST(mask == 15);
+
+    bitbuf_skip_byte_padding(&read);
+
+    TEST(bitbuf_read_n_bits(&read, 7, NULL) == 121);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_buffer_overflow(void)
+{
+    // write non-overflow -- cursor aligns to end of only segment, but
+    // does not overflow
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
+        bitbuf_write_uint64(&buf, 0xFF);
+        TEST(!bitbuf_has_truncated(&buf));
+        bitbuf_free_buffer(&buf);
+    }
+
+    // write overflow on non-aligned write
+    {
+        // this allocates 64 bits because bitbuffer rounds up to segment width.
+        // we then write 65 bits, and expect a truncation.
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
+        bitbuf_write_bool(&buf, true);
+        bitbuf_write_uint64(&buf, 0xFF);
+
+        // expect an assert to be triggered in previous bitbuf call
+        TEST(ftgt_test_errorlevel());
+
+        TEST(bitbuf_has_truncated(&buf));
+        buf.truncated = 0;
+        bitbuf_free_buffer(&buf);
+    }
+
+    // read non-overflow -- cursor aligns to end of single byte
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
+        bitbuf_write_uint64(&buf, 0xFF);
+
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        uint64_t        value = bitbuf_read_uint64(&read);
+        TEST(value == 0xFF);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // read overflow
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
+        bitbuf_write_uint64(&buf, 0xFF);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        uint64_t        value;
+        value = bitbuf_read_uint64(&read);
+        TEST(value == 0xFF);
+
+        // read past end
+        bitbuf_read_uint64(&read);
+        value = bitbuf_read_uint64(&read);
+        TEST(read.read_past_end == 1);
+        TEST(ftgt_test_errorlevel());
+        TEST(value == 0);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_align_to_end_of_segment(void)
+{
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(16);
+
+    uint64_t BIG = 0x7FFFFFFFFFFFFFFFull;
+
+    bitbuf_write_n_bits(&buf, 63, BIG);
+    bitbuf_pad_to_byte(&buf);
+    bitbuf_write_int32(&buf, -500000);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+
+    uint64_t value = bitbuf_read_n_bits(&read, 63, NULL);
+    TEST(value == BIG);
+
+    bitbuf_skip_byte_padding(&read);
+    TEST(bitbuf_read_int32(&read) == -500000);
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_write_after_read(void)
+{
+    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+
+    bitbuf_cursor_init(buf);
+    bitbuf_write_bool(buf, false);
+
+    TEST(ftgt_test_errorlevel());
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_crop_set_bit_on_n_write(void)
+{
+    bitbuf_write_n_bits(&bitbuf__tv.buf, 1, 3);
+    TEST(ftgt_test_errorlevel());
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_cstr_overflow(void)
+{
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(5);
+
+    // implementation detail dependency
+    TEST(buf.capacity_bytes == 8);
+
+    // catch assert for overflow on null terminator
+    bitbuf_write_cstr(&buf, "abcdefgh");
+
+    TEST(ftgt_test_errorlevel());
+    TEST(bitbuf_has_truncated(&buf));
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_read_buffers(void)
+{
+    const char STR[] = "abcdefgh";
+
+    {
+        size_t i;
+        bitbuf_buffer_t buf =
+            bitbuf_alloc_buffer_with_bytes((uint8_t*)STR, strlen(STR));
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+
+        for (i = 0; i < strlen(STR); i++) {
+            TEST(bitbuf_read_uint8(&read) == (uint8_t)STR[i]);
+        }
+
+        bitbuf_free_buffer(&buf);
+
+        return ftgt_test_errorlevel();
+    }
+
+    {
+        size_t i;
+        bitbuf_buffer_t buf =
+            bitbuf_init_buffer_with_bytes((uint8_t*)STR, strlen(STR));
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+
+        for (i = 0; i < strlen(STR); i++) {
+            TEST(bitbuf_read_uint8(&read) == (uint8_t)STR[i]);
+        }
+
+        return ftgt_test_errorlevel();
+    }
+}
+
+
+static int
+bitbuf__test_qfloat(void)
+{
+    const int    STORE_BITS[] = {4, 8, 16, 24, 31};
+    const size_t STORE_BITS_LEN = sizeof(STORE_BITS) / sizeof(STORE_BITS[0]);
+    size_t i;
+
+
+    const float TEST_RANGES[][3] = {
+        /* min, max */
+        {+0.0f, +1.0f},
+        {-1.0, 0.0f},
+        {-1.0f, 1.0f},
+        {-32000.f, 32000.f},
+    };
+    const size_t TEST_RANGES_LEN = sizeof(TEST_RANGES) / sizeof(TEST_RANGES[0]);
+
+
+    for (i = 0; i < TEST_RANGES_LEN; i++) {
+        size_t n;
+
+        // todo: get this working with sizeof(float) * 3
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(256);
+
+        float in_min = TEST_RANGES[i][0];
+        float in_max = TEST_RANGES[i][1];
+
+        for (n = 0; n < STORE_BITS_LEN; n++) {
+            int num_bits = STORE_BITS[n];
+
+            bitbuf_write_quantized_float(&buf, num_bits, in_min, in_max, in_min);
+            bitbuf_write_quantized_float(&buf, num_bits, in_min, in_max, in_max);
+        }
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+
+        for (n = 0; n < STORE_BITS_LEN; n++) {
+            int num_bits = STORE_BITS[n];
+
+            float min = bitbuf_read_quantized_float(&read, num_bits, in_min, in_max);
+            float max = bitbuf_read_quantized_float(&read, num_bits, in_min, in_max);
+
+            TEST(min == in_min);
+            TEST(max == in_max);
+        }
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_get_bytes_from_buffer(void)
+{
+    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+
+    size_t num_bytes;
+    TEST(bitbuf_get_bytes_from_buffer(buf, &num_bytes) == (uint8_t*)buf->data);
+    TEST(num_bytes == 0);
+
+    bitbuf_write_bool(buf, true);
+    bitbuf_get_bytes_from_buffer(buf, &num_bytes);
+    TEST(num_bytes == 1);
+
+    bitbuf_write_uint64(buf, 0xFF00FF00FF00FF00);
+    bitbuf_get_bytes_from_buffer(buf, &num_bytes);
+    TEST(num_bytes == 9);
+
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_growable(void)
+{
+    size_t i;
+
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_growable_buffer(1);
+
+        for (i = 0; i < 1000; i++) {
+            bitbuf_write_bool(&buf, i & 1);
+            bitbuf_write_uint32(&buf, (uint32_t)i);
+        }
+        TEST(!bitbuf_has_truncated(&buf));
+        TEST(buf.capacity_bytes == 8192);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        for (i = 0; i < 1000; i++) {
+            TEST(bitbuf_read_bool(&read) == (bool)(i & 1));
+            TEST(bitbuf_read_uint32(&read) == (uint32_t)i);
+        }
+
+        bitbuf_free_buffer(&buf);
+    }
+
+#ifdef FTG__INCLUDE_CORE_H
+    {
+        ftg_arena_t*    arena = ftg_arena_new();
+        bitbuf_buffer_t buf = bitbuf_alloc_growable_buffer_in_arena(&arena, 8);
+
+        for (i = 0; i < 1000; i++) {
+            bitbuf_write_n_bits(&buf, 13, i);
+        }
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        for (i = 0; i < 1000; i++) {
+            TEST(bitbuf_read_n_bits(&read, 13, NULL) == i);
+        }
+
+        ftg_arena_free(arena);
+    }
+#endif
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_writer(void)
+{
+    const int WIDTHS[] = {1, 3, 64, 17, 63, 32, 8, 11};
+    const int NUM_WIDTHS = sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+    int       i;
+
+    // interleave with regular writes, straddling segments
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(512);
+
+        bitbuf_write_n_bits(&buf, 5, 21);
+
+        bitbuf_writer_t writer = bitbuf_writer_begin(&buf);
+        for (i = 0; i < 100; i++) {
+            int num_bits = WIDTHS[i % NUM_WIDTHS];
+            bitbuf_writer_write_n_bits(
+                &writer, num_bits, (0x9E3779B97F4A7C15ull * i) & bitbuf__spanmasktable[num_bits]);
+        }
+        bitbuf_writer_end(&writer);
+
+        bitbuf_write_uint8(&buf, 0xAB);
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        TEST(bitbuf_read_n_bits(&read, 5, NULL) == 21);
+        for (i = 0; i < 100; i++) {
+            int num_bits = WIDTHS[i % NUM_WIDTHS];
+            TEST(bitbuf_read_n_bits(&read, num_bits, NULL) ==
+                 ((0x9E3779B97F4A7C15ull * i) & bitbuf__spanmasktable[num_bits]));
+        }
+        TEST(bitbuf_read_uint8(&read) == 0xAB);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // growable
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_growable_buffer(8);
+        bitbuf_writer_t writer = bitbuf_writer_begin(&buf);
+        for (i = 0; i < 1000; i++) {
+            bitbuf_writer_write_n_bits(&writer, 11, i);
+        }
+        bitbuf_writer_end(&writer);
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        for (i = 0; i < 1000; i++) {
+            TEST(bitbuf_read_n_bits(&read, 11, NULL) == (uint64_t)i);
+        }
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // truncation
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(8);
+        bitbuf_writer_t writer = bitbuf_writer_begin(&buf);
+        bitbuf_writer_write_n_bits(&writer, 64, 1);
+        bitbuf_writer_write_n_bits(&writer, 1, 1);
+        bitbuf_writer_end(&writer);
+
+        TEST(ftgt_test_errorlevel());
+        TEST(bitbuf_has_truncated(&buf));
         buf.truncated = 0;
         bitbuf_free_buffer(&buf);
     }
 
-    // read non-overflow -- cursor aligns to end of single byte
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_reader(void)
+{
+    const int WIDTHS[] = {1, 3, 64, 17, 63, 32, 8, 11};
+    const int NUM_WIDTHS = sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+    int       i;
+
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(512);
+
+    bitbuf_write_n_bits(&buf, 5, 21);
+    for (i = 0; i < 100; i++) {
+        int num_bits = WIDTHS[i % NUM_WIDTHS];
+        bitbuf_write_n_bits(
+            &buf, num_bits, (0x9E3779B97F4A7C15ull * i) & bitbuf__spanmasktable[num_bits]);
+    }
+    bitbuf_pad_to_byte(&buf);
+    bitbuf_write_uint8(&buf, 0xAB);
+
+    // start mid-segment from a cursor
+    bitbuf_cursor_t cursor = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_n_bits(&cursor, 5, NULL) == 21);
+
+    bitbuf_reader_t reader = bitbuf_reader_init_at(&cursor);
+    for (i = 0; i < 100; i++) {
+        int num_bits = WIDTHS[i % NUM_WIDTHS];
+        TEST(bitbuf_reader_read_n_bits(&reader, num_bits) ==
+             ((0x9E3779B97F4A7C15ull * i) & bitbuf__spanmasktable[num_bits]));
+    }
+    bitbuf_reader_skip_byte_padding(&reader);
+
+    // hand back to a cursor
+    cursor = bitbuf_reader_get_cursor(&reader);
+    TEST(bitbuf_read_uint8(&cursor) == 0xAB);
+
+    // read past end
+    reader = bitbuf_reader_init(&buf);
+    for (i = 0; i < 64; i++) {
+        bitbuf_reader_read_n_bits(&reader, 64);
+    }
+    TEST(reader.read_past_end == 0);
+    TEST(bitbuf_reader_read_n_bits(&reader, 1) == 0);
+    TEST(reader.read_past_end == 1);
+    TEST(ftgt_test_errorlevel());
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_arrays(void)
+{
+    uint16_t ids[1001];
+    uint16_t out_ids[1001];
+    uint64_t wide[9];
+    uint64_t out_wide[9];
+    uint32_t full[7];
+    uint32_t out_full[7];
+    size_t   i;
+
+    for (i = 0; i < 1001; i++) {
+        ids[i] = (uint16_t)((i * 37) & 0x7ff);
+    }
+    for (i = 0; i < 9; i++) {
+        wide[i] = 0x9E3779B97F4A7C15ull * (i + 1);
+    }
+    for (i = 0; i < 7; i++) {
+        full[i] = (uint32_t)(0xDEADBEEFu * (i + 1));
+    }
+
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(2048);
+
+    // unaligned packing, then byte aligned copies
+    bitbuf_write_bool(&buf, true);
+    bitbuf_write_n_bits_array_uint16(&buf, 11, ids, 1001);
+    bitbuf_write_n_bits_array_uint64(&buf, 64, wide, 9);
+    bitbuf_pad_to_byte(&buf);
+    bitbuf_write_uint32_array(&buf, full, 7);
+    bitbuf_write_bool(&buf, true);
+    TEST(!bitbuf_has_truncated(&buf));
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_bool(&read) == true);
+    bitbuf_read_n_bits_array_uint16(&read, 11, out_ids, 1001);
+    TEST(memcmp(ids, out_ids, sizeof(ids)) == 0);
+    bitbuf_read_n_bits_array_uint64(&read, 64, out_wide, 9);
+    TEST(memcmp(wide, out_wide, sizeof(wide)) == 0);
+    bitbuf_skip_byte_padding(&read);
+    bitbuf_read_uint32_array(&read, out_full, 7);
+    TEST(memcmp(full, out_full, sizeof(full)) == 0);
+    TEST(bitbuf_read_bool(&read) == true);
+
+    // an array that does not fit is not partially written
+    bitbuf_buffer_t small = bitbuf_alloc_buffer(8);
+    bitbuf_write_uint8(&small, 0x5A);
+    bitbuf_write_uint16_array(&small, ids, 4);
+    TEST(ftgt_test_errorlevel());
+    TEST(bitbuf_has_truncated(&small));
+
+    size_t num_bytes;
+    bitbuf_get_bytes_from_buffer(&small, &num_bytes);
+    TEST(num_bytes == 1);
+
+    small.truncated = 0;
+    bitbuf_free_buffer(&small);
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_bytes(void)
+{
+    const char* LONG_STR = "the quick brown fox jumps over the lazy dog";
+    uint8_t     blob[37];
+    uint8_t     out_blob[37];
+    char        str[64];
+    int         offset;
+    size_t      i;
+
+    for (i = 0; i < sizeof(blob); i++) {
+        blob[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    // every bit offset within a byte, covering aligned and unaligned paths
+    for (offset = 0; offset < 8; offset++) {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(256);
+
+        bitbuf_write_n_bits(&buf, offset, 0);
+        bitbuf_write_cstr(&buf, LONG_STR);
+        bitbuf_write_cstr(&buf, "");
+        bitbuf_write_bytes(&buf, blob, sizeof(blob));
+        bitbuf_write_cstr(&buf, "abc");
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_n_bits(&read, offset, NULL);
+
+        bitbuf_read_cstr(&read, sizeof(str), str);
+        TEST(strcmp(str, LONG_STR) == 0);
+        bitbuf_read_cstr(&read, sizeof(str), str);
+        TEST(str[0] == '\0');
+        bitbuf_read_bytes(&read, out_blob, sizeof(out_blob));
+        TEST(memcmp(blob, out_blob, sizeof(blob)) == 0);
+
+        // no room for null terminator; the cursor is left after 3 bytes
+        bitbuf_cursor_t read2 = read;
+        bitbuf_read_cstr(&read2, 3, str);
+        TEST(str[0] == '\0');
+        TEST(bitbuf_read_uint8(&read2) == 0);
+
+        bitbuf_read_cstr(&read, sizeof(str), str);
+        TEST(strcmp(str, "abc") == 0);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // unterminated string running off the end of the buffer
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(8);
+        bitbuf_write_n_bits(&buf, 3, 0);
+        bitbuf_write_bytes(&buf, "abcdefg", 7);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_n_bits(&read, 3, NULL);
+        bitbuf_read_cstr(&read, sizeof(str), str);
+        TEST(ftgt_test_errorlevel());
+        TEST(read.read_past_end == 1);
+        TEST(strcmp(str, "abcdefg") == 0);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_views(void)
+{
+    const uint8_t BLOB[5] = {1, 2, 3, 4, 5};
+    size_t        len;
+
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(64);
+
+    bitbuf_write_n_bits(&buf, 3, 5);
+    bitbuf_pad_to_byte(&buf);
+    bitbuf_write_cstr(&buf, "hello, world");
+    bitbuf_write_bytes(&buf, BLOB, sizeof(BLOB));
+    bitbuf_write_bool(&buf, true);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == 5);
+
+    // unaligned
+    TEST(bitbuf_read_cstr_view(&read, &len) == NULL);
+    TEST(ftgt_test_errorlevel());
+
+    bitbuf_skip_byte_padding(&read);
+
+    const char* str = bitbuf_read_cstr_view(&read, &len);
+    TEST(strcmp(str, "hello, world") == 0);
+    TEST(len == strlen("hello, world"));
+    TEST(str == (const char*)buf.data + 1);
+
+    const uint8_t* blob = bitbuf_read_bytes_view(&read, sizeof(BLOB));
+    TEST(memcmp(blob, BLOB, sizeof(BLOB)) == 0);
+
+    TEST(bitbuf_read_bool(&read) == true);
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_varint(void)
+{
+    const int      GROUPS[] = {1, 4, 7, 13, 32, 63};
+    const uint64_t UVALUES[] = {0, 1, 15, 16, 127, 128, 300, 0xFFFFFFFFull, ~0ull};
+    const int64_t  IVALUES[] = {0, -1, 1, -64, 64, INT64_MAX, INT64_MIN};
+    size_t         g, i;
+
+    for (g = 0; g < sizeof(GROUPS) / sizeof(GROUPS[0]); g++) {
+        int             group_bits = GROUPS[g];
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(512);
+
+        for (i = 0; i < sizeof(UVALUES) / sizeof(UVALUES[0]); i++) {
+            bitbuf_write_varint_u64(&buf, group_bits, UVALUES[i]);
+        }
+        for (i = 0; i < sizeof(IVALUES) / sizeof(IVALUES[0]); i++) {
+            bitbuf_write_varint_i64(&buf, group_bits, IVALUES[i]);
+        }
+        TEST(!bitbuf_has_truncated(&buf));
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        for (i = 0; i < sizeof(UVALUES) / sizeof(UVALUES[0]); i++) {
+            TEST(bitbuf_read_varint_u64(&read, group_bits) == UVALUES[i]);
+        }
+        for (i = 0; i < sizeof(IVALUES) / sizeof(IVALUES[0]); i++) {
+            TEST(bitbuf_read_varint_i64(&read, group_bits) == IVALUES[i]);
+        }
+        TEST(read.read_past_end == 0);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // sizes: 300 is 9 bits, so two 7-bit groups
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(8);
+        size_t          num_bytes;
+
+        bitbuf_write_varint_u64(&buf, 7, 300);
+        bitbuf_get_bytes_from_buffer(&buf, &num_bytes);
+        TEST(num_bytes == 2);
+        TEST(buf.write.bits_into_seg == 16);
+
+        // ends exactly at the end of the buffer
+        bitbuf_write_varint_i64(&buf, 4, -5);
+        bitbuf_write_n_bits(&buf, 38, 0);
+        bitbuf_write_varint_u64(&buf, 4, 1);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        TEST(bitbuf_read_varint_u64(&read, 7) == 300);
+        TEST(bitbuf_read_varint_i64(&read, 4) == -5);
+        bitbuf_read_n_bits(&read, 38, NULL);
+        TEST(bitbuf_read_varint_u64(&read, 4) == 1);
+        TEST(read.read_past_end == 0);
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    // a varint longer than 64 bits read after an earlier failed read
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(16);
+
+        bitbuf_write_varint_u64(&buf, 7, 0x123456789abcdefull);
+        bitbuf_write_bool(&buf, true);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_cursor_seek_bits(&read, 16 * 8 - 8);
+        bitbuf_read_n_bits(&read, 9, NULL);
+        TEST(read.read_past_end == 1);
+        TEST(ftgt_test_errorlevel());
+
+        bitbuf_cursor_seek_bits(&read, 0);
+        TEST(bitbuf_read_varint_u64(&read, 7) == 0x123456789abcdefull);
+        TEST(bitbuf_read_bool(&read));
+
+        bitbuf_free_buffer(&buf);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_ranged_int(void)
+{
+    // compile time widths fold to constants
+    char width_is_constant[BITBUF_BITS_FOR_RANGE(0, 1023)];
+    TEST(sizeof(width_is_constant) == 10);
+
+    TEST(BITBUF_BITS_FOR_RANGE(-8, 7) == 4);
+    TEST(BITBUF_BITS_FOR_RANGE(5, 5) == 0);
+    TEST(BITBUF_BITS_FOR_RANGE(INT64_MIN, INT64_MAX) == 64);
+    TEST(bitbuf_bits_for_range(-8, 7) == 4);
+    TEST(bitbuf_bits_for_range(100, 1123) == 10);
+    TEST(bitbuf_bits_for_range(INT64_MIN, INT64_MAX) == 64);
+
+    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+
+    bitbuf_write_ranged_int(buf, -8, 7, -8);
+    bitbuf_write_ranged_int(buf, -8, 7, 7);
+    bitbuf_write_ranged_int(buf, 5, 5, 5);
+    bitbuf_write_ranged_int(buf, 100, 1123, 1000);
+    bitbuf_write_ranged_int(buf, INT64_MIN, INT64_MAX, INT64_MIN);
+    bitbuf_write_ranged_int(buf, INT64_MIN, INT64_MAX, -1);
+    TEST(bitbuf__tv.buf.write.bits_into_seg == 4 + 4 + 0 + 10 + 64 + 64 - 128);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(buf);
+    TEST(bitbuf_read_ranged_int(&read, -8, 7) == -8);
+    TEST(bitbuf_read_ranged_int(&read, -8, 7) == 7);
+    TEST(bitbuf_read_ranged_int(&read, 5, 5) == 5);
+    TEST(bitbuf_read_ranged_int(&read, 100, 1123) == 1000);
+    TEST(bitbuf_read_ranged_int(&read, INT64_MIN, INT64_MAX) == INT64_MIN);
+    TEST(bitbuf_read_ranged_int(&read, INT64_MIN, INT64_MAX) == -1);
+
+    return ftgt_test_errorlevel();
+}
+
+static void
+bitbuf__test_write_snapshot(bitbuf_buffer_t* buf, const uint64_t* values)
+{
+    bitbuf_write_bool(buf, values[0] != 0);
+    bitbuf_write_n_bits(buf, 7, values[1]);
+    bitbuf_write_uint32(buf, (uint32_t)values[2]);
+    bitbuf_write_uint64(buf, values[3]);
+    bitbuf_write_n_bits(buf, 13, values[4]);
+    bitbuf_write_n_bits(buf, 3, values[5]);
+}
+
+static int
+bitbuf__test_delta(void)
+{
+    const int      LAYOUT[] = {1, 7, 32, 64, 13, 3};
+    const size_t   NUM_FIELDS = sizeof(LAYOUT) / sizeof(LAYOUT[0]);
+    const uint64_t BASE[] = {1, 100, 0xDEADBEEF, 0x0123456789ABCDEFull, 4000, 5};
+    const uint64_t CUR[] = {1, 101, 0xDEADBEEF, 0x0123456789ABCDEFull, 4000, 2};
+
+    bitbuf_buffer_t baseline = bitbuf_alloc_buffer(32);
+    bitbuf_buffer_t current = bitbuf_alloc_buffer(32);
+    bitbuf_buffer_t delta = bitbuf_alloc_buffer(64);
+    bitbuf_buffer_t out = bitbuf_alloc_buffer(32);
+    bitbuf_buffer_t out_same = bitbuf_alloc_buffer(32);
+    size_t          num_bytes;
+
+    bitbuf__test_write_snapshot(&baseline, BASE);
+    bitbuf__test_write_snapshot(&current, CUR);
+
+    bitbuf_write_delta(&delta, &baseline, &current, LAYOUT, NUM_FIELDS);
+    bitbuf_write_delta(&delta, &baseline, &baseline, LAYOUT, NUM_FIELDS);
+    bitbuf_write_bool(&delta, true);
+
+    // changed bit + 6 mask bits + 7 + 3 value bits, then 1 unchanged bit
+    TEST(delta.write.bits_into_seg == 1 + 6 + 7 + 3 + 1 + 1);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&delta);
+    bitbuf_read_delta(&read, &baseline, &out, LAYOUT, NUM_FIELDS);
+    bitbuf_read_delta(&read, &baseline, &out_same, LAYOUT, NUM_FIELDS);
+    TEST(bitbuf_read_bool(&read) == true);
+
+    bitbuf_get_bytes_from_buffer(&current, &num_bytes);
+    TEST(memcmp(out.data, current.data, num_bytes) == 0);
+    TEST(bitbuf__cursor_pos(&out.write, out.data) ==
+         bitbuf__cursor_pos(&current.write, current.data));
+
+    bitbuf_get_bytes_from_buffer(&baseline, &num_bytes);
+    TEST(memcmp(out_same.data, baseline.data, num_bytes) == 0);
+
+    bitbuf_free_buffer(&baseline);
+    bitbuf_free_buffer(&current);
+    bitbuf_free_buffer(&delta);
+    bitbuf_free_buffer(&out);
+    bitbuf_free_buffer(&out_same);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_vec3_quat(void)
+{
+    const float VECS[][3] = {
+        {-100.0f, 0.0f, 100.0f},
+        {12.5f, -37.25f, 99.0f},
+        {-100.0f, -100.0f, -100.0f},
+    };
+    const size_t NUM_VECS = sizeof(VECS) / sizeof(VECS[0]);
+    const int    AXIS_BITS[3] = {10, 12, 7};
+    const float  AXIS_MIN[3] = {-100.0f, -50.0f, -100.0f};
+    const float  AXIS_MAX[3] = {100.0f, 50.0f, 100.0f};
+
+    // x, y, z, w
+    const float QUATS[][4] = {
+        {0.0f, 0.0f, 0.0f, 1.0f},
+        {0.0f, 0.0f, 0.0f, -1.0f},
+        {0.5f, -0.5f, 0.5f, -0.5f},
+        {0.18257419f, 0.36514837f, -0.54772256f, 0.73029674f},
+    };
+    const size_t NUM_QUATS = sizeof(QUATS) / sizeof(QUATS[0]);
+
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(256);
+    float           vecs_out[sizeof(VECS) / sizeof(VECS[0])][3];
+    float           v[3];
+    float           quats_out[sizeof(QUATS) / sizeof(QUATS[0])][4];
+    size_t          i;
+    int             c;
+
+    bitbuf_write_quantized_vec3_array(&buf, 16, -100.0f, 100.0f, &VECS[0][0], NUM_VECS);
+    bitbuf_write_quantized_vec3_axes(&buf, AXIS_BITS, AXIS_MIN, AXIS_MAX, VECS[1]);
+    bitbuf_write_quat_array(&buf, 12, &QUATS[0][0], NUM_QUATS);
+    TEST(!bitbuf_has_truncated(&buf));
+    TEST(bitbuf__cursor_pos(&buf.write, buf.data) ==
+         NUM_VECS * 3 * 16 + 10 + 12 + 7 + NUM_QUATS * (2 + 3 * 12));
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    bitbuf_read_quantized_vec3_array(&read, 16, -100.0f, 100.0f, &vecs_out[0][0], NUM_VECS);
+    bitbuf_read_quantized_vec3_axes(&read, AXIS_BITS, AXIS_MIN, AXIS_MAX, v);
+    bitbuf_read_quat_array(&read, 12, &quats_out[0][0], NUM_QUATS);
+
+    // vectors match the scalar quantizer
+    bitbuf_buffer_t scalar = bitbuf_alloc_buffer(64);
+    for (c = 0; c < 3; c++) {
+        bitbuf_write_quantized_float(&scalar, 16, -100.0f, 100.0f, VECS[1][c]);
+    }
+    bitbuf_cursor_t scalar_read = bitbuf_cursor_init(&scalar);
+    for (c = 0; c < 3; c++) {
+        TEST(vecs_out[1][c] == bitbuf_read_quantized_float(&scalar_read, 16, -100.0f, 100.0f));
+    }
+    bitbuf_free_buffer(&scalar);
+
+    // endpoints are exact
+    TEST(vecs_out[0][0] == -100.0f && vecs_out[0][2] == 100.0f);
+    TEST(vecs_out[2][0] == -100.0f && vecs_out[2][1] == -100.0f);
+
+    for (c = 0; c < 3; c++) {
+        TEST(fabsf(v[c] - VECS[1][c]) < 1.0f);
+    }
+
+    for (i = 0; i < NUM_QUATS; i++) {
+        float dot = 0.0f;
+
+        for (c = 0; c < 4; c++) {
+            dot += QUATS[i][c] * quats_out[i][c];
+        }
+
+        // same rotation, possibly with the sign flipped
+        TEST(fabsf(fabsf(dot) - 1.0f) < 1e-4f);
+    }
+
+    bitbuf_free_buffer(&buf);
+
+    // max is in range, though min + (max - min) rounds below it
+    {
+        const float MIN[3] = {-44.4450569f, -44.4450569f, -44.4450569f};
+        const float MAX[3] = {10.9529428f, 10.9529428f, 10.9529428f};
+
+        TEST(MIN[0] + (MAX[0] - MIN[0]) < MAX[0]);
+
+        buf = bitbuf_alloc_buffer(64);
+        bitbuf_write_quantized_vec3_axes(&buf, AXIS_BITS, MIN, MAX, MAX);
+        read = bitbuf_cursor_init(&buf);
+        bitbuf_read_quantized_vec3_axes(&read, AXIS_BITS, MIN, MAX, v);
+        TEST(fabsf(v[0] - MAX[0]) < 1e-5f);
+        bitbuf_free_buffer(&buf);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_quantized_float_array(void)
+{
+    const int    STORE_BITS[] = {1, 5, 12, 23, 24, 31};
+    const size_t STORE_BITS_LEN = sizeof(STORE_BITS) / sizeof(STORE_BITS[0]);
+    const size_t COUNT = 301;
+
+    float* values = (float*)BITBUF_MALLOC(COUNT * sizeof(float));
+    float* out = (float*)BITBUF_MALLOC(COUNT * sizeof(float));
+    size_t i, n;
+
+    // endpoints, values near the saturation boundary and a sweep
+    for (i = 0; i < COUNT; i++) {
+        values[i] = -1000.0f + 2000.0f * (float)i / (float)(COUNT - 1);
+    }
+    values[3] = 1000.0f;
+    values[7] = 999.99994f;
+    values[11] = -999.99994f;
+
+    for (n = 0; n < STORE_BITS_LEN; n++) {
+        const int num_bits = STORE_BITS[n];
+
+        bitbuf_buffer_t array_buf = bitbuf_alloc_buffer(COUNT * 4 + 8);
+        bitbuf_buffer_t scalar_buf = bitbuf_alloc_buffer(COUNT * 4 + 8);
+        size_t          num_array_bytes, num_scalar_bytes;
+
+        // offset by one bit so the packed fields straddle segments
+        bitbuf_write_bool(&array_buf, true);
+        bitbuf_write_bool(&scalar_buf, true);
+
+        bitbuf_write_quantized_float_array(&array_buf, num_bits, -1000.0f, 1000.0f, values, COUNT);
+        for (i = 0; i < COUNT; i++) {
+            bitbuf_write_quantized_float(&scalar_buf, num_bits, -1000.0f, 1000.0f, values[i]);
+        }
+
+        const uint8_t* array_bytes = bitbuf_get_bytes_from_buffer(&array_buf, &num_array_bytes);
+        const uint8_t* scalar_bytes = bitbuf_get_bytes_from_buffer(&scalar_buf, &num_scalar_bytes);
+        TEST(num_array_bytes == num_scalar_bytes);
+        TEST(memcmp(array_bytes, scalar_bytes, num_array_bytes) == 0);
+
+        bitbuf_cursor_t read = bitbuf_cursor_init(&array_buf);
+        bitbuf_cursor_t scalar_read = bitbuf_cursor_init(&scalar_buf);
+        bitbuf_read_bool(&read);
+        bitbuf_read_bool(&scalar_read);
+
+        bitbuf_read_quantized_float_array(&read, num_bits, -1000.0f, 1000.0f, out, COUNT);
+        for (i = 0; i < COUNT; i++) {
+            TEST(out[i] ==
+                 bitbuf_read_quantized_float(&scalar_read, num_bits, -1000.0f, 1000.0f));
+        }
+
+        bitbuf_free_buffer(&array_buf);
+        bitbuf_free_buffer(&scalar_buf);
+    }
+
+    BITBUF_FREE(values);
+    BITBUF_FREE(out);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_half_bfloat16(void)
+{
+    // float bits, half bits, bfloat16 bits
+    const uint32_t CASES[][3] = {
+        {0x3f800000, 0x3c00, 0x3f80}, // 1.0
+        {0x80000000, 0x8000, 0x8000}, // -0.0
+        {0x477fe000, 0x7bff, 0x4780}, // 65504, largest half
+        {0x477ff000, 0x7c00, 0x4780}, // 65520, rounds to inf
+        {0x38800000, 0x0400, 0x3880}, // 2^-14, smallest normal half
+        {0x33800000, 0x0001, 0x3380}, // 2^-24, smallest subnormal half
+        {0x33000000, 0x0000, 0x3300}, // 2^-25, tie rounds to even zero
+        {0x33400000, 0x0001, 0x3340}, // 1.5 * 2^-25
+        {0x3f801000, 0x3c00, 0x3f80}, // 1 + 2^-11, tie rounds to even
+        {0x3f803000, 0x3c02, 0x3f80}, // 1 + 3 * 2^-11, tie rounds to even
+        {0x3f808000, 0x3c04, 0x3f80}, // 1 + 2^-8, bfloat16 tie
+        {0x3f818000, 0x3c0c, 0x3f82}, // 1 + 3 * 2^-8, bfloat16 tie
+        {0xff800000, 0xfc00, 0xff80}, // -inf
+        {0x7fc00000, 0x7e00, 0x7fc0}, // quiet NaN
+        {0x7f800001, 0x7e00, 0x7fc0}, // signaling NaN is quieted
+    };
+    const size_t NUM_CASES = sizeof(CASES) / sizeof(CASES[0]);
+
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(1024);
+    float           values[sizeof(CASES) / sizeof(CASES[0])];
+    float           out[sizeof(CASES) / sizeof(CASES[0])];
+    size_t          i;
+
+    for (i = 0; i < NUM_CASES; i++) {
+        values[i] = bitbuf__bits_float(CASES[i][0]);
+
+        TEST(bitbuf__float_to_half(values[i]) == CASES[i][1]);
+        TEST(bitbuf__float_to_bfloat16(values[i]) == CASES[i][2]);
+    }
+
+    // every half converts to a float that converts back to it
+    for (i = 0; i < 0x10000; i++) {
+        TEST(bitbuf__float_to_half(bitbuf__half_to_float((uint16_t)i)) == i ||
+             ((i & 0x7c00) == 0x7c00 && (i & 0x3ff) != 0));
+    }
+
+    bitbuf_write_bool(&buf, true);
+    bitbuf_write_half_array(&buf, values, NUM_CASES);
+    bitbuf_write_bfloat16_array(&buf, values, NUM_CASES);
+    for (i = 0; i < NUM_CASES; i++) {
+        bitbuf_write_half(&buf, values[i]);
+        bitbuf_write_bfloat16(&buf, values[i]);
+    }
+    TEST(!bitbuf_has_truncated(&buf));
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_bool(&read));
+
+    bitbuf_read_half_array(&read, out, NUM_CASES);
+    for (i = 0; i < NUM_CASES; i++) {
+        TEST(bitbuf__float_to_half(out[i]) == CASES[i][1]);
+    }
+
+    bitbuf_read_bfloat16_array(&read, out, NUM_CASES);
+    for (i = 0; i < NUM_CASES; i++) {
+        TEST(bitbuf__float_bits(out[i]) == (uint32_t)CASES[i][2] << 16);
+    }
+
+    for (i = 0; i < NUM_CASES; i++) {
+        TEST(bitbuf__float_to_half(bitbuf_read_half(&read)) == CASES[i][1]);
+        TEST(bitbuf__float_bits(bitbuf_read_bfloat16(&read)) == (uint32_t)CASES[i][2] << 16);
+    }
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_checkpoint(void)
+{
+    // 24 bytes fits four 40-bit entities after a 7-bit header
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(24);
+    bitbuf_buffer_t expected = bitbuf_alloc_buffer(24);
+    int             num_fit = 0;
+    int             i;
+
+    bitbuf_write_n_bits(&buf, 7, 0x55);
+    bitbuf_write_n_bits(&expected, 7, 0x55);
+
+    // greedily fill with entities, rolling back the one that truncates
+    for (i = 0; i < 6; i++) {
+        bitbuf_checkpoint_t cp = bitbuf_checkpoint(&buf);
+
+        bitbuf_write_uint32(&buf, 0xFFFFFFFF);
+        bitbuf_write_uint8(&buf, (uint8_t)i);
+
+        if (bitbuf_has_truncated(&buf)) {
+            bitbuf_rollback(&buf, &cp);
+        } else {
+            bitbuf_commit(&buf, &cp);
+            bitbuf_write_uint32(&expected, 0xFFFFFFFF);
+            bitbuf_write_uint8(&expected, (uint8_t)i);
+            num_fit++;
+        }
+    }
+    TEST(num_fit == 4);
+    TEST(!bitbuf_has_truncated(&buf));
+    TEST(buf.open_checkpoints == 0);
+
+    // the partially written entity left no bits behind
+    TEST(memcmp(buf.data, expected.data, 24) == 0);
+
+    // nested checkpoints, rolling back into the middle of a segment
+    bitbuf_buffer_t nested = bitbuf_alloc_buffer(32);
+    bitbuf_write_n_bits(&nested, 3, 0x5);
+
+    bitbuf_checkpoint_t outer = bitbuf_checkpoint(&nested);
+    bitbuf_write_uint64(&nested, ~0ull);
+    bitbuf_checkpoint_t inner = bitbuf_checkpoint(&nested);
+    bitbuf_write_uint64(&nested, ~0ull);
+    bitbuf_write_uint64(&nested, ~0ull);
+    bitbuf_rollback(&nested, &inner);
+    TEST(bitbuf__cursor_pos(&nested.write, nested.data) == 67);
+    TEST(nested.data[1] == 0x7 && nested.data[2] == 0);
+    bitbuf_rollback(&nested, &outer);
+    TEST(bitbuf__cursor_pos(&nested.write, nested.data) == 3);
+    TEST(nested.data[0] == 0x5 && nested.data[1] == 0);
+
+    bitbuf_write_bool(&nested, true);
+    bitbuf_cursor_t read = bitbuf_cursor_init(&nested);
+    TEST(bitbuf_read_n_bits(&read, 4, NULL) == 0xD);
+
+    bitbuf_free_buffer(&buf);
+    bitbuf_free_buffer(&expected);
+    bitbuf_free_buffer(&nested);
+
+    return ftgt_test_errorlevel();
+}
+
+// every kind of write, so measuring can be compared against real sizes
+static void
+bitbuf__test_write_mixed(bitbuf_buffer_t* buf)
+{
+    const uint16_t IDS[5] = {1, 2, 3, 4, 5};
+    const float    FLOATS[3] = {0.25f, 0.5f, 0.75f};
+    const uint8_t  BYTES[11] = {0};
+
+    bitbuf_write_bool(buf, true);
+    bitbuf_write_uint32(buf, 0xDEADBEEF);
+    bitbuf_write_n_bits(buf, 13, 0x1234);
+    bitbuf_write_varint_u64(buf, 7, 300);
+    bitbuf_write_ranged_int(buf, -10, 10, 3);
+    bitbuf_write_cstr(buf, "measure");
+    bitbuf_write_n_bits_array_uint16(buf, 11, IDS, 5);
+    bitbuf_write_quantized_float_array(buf, 9, 0.0f, 1.0f, FLOATS, 3);
+    bitbuf_write_half(buf, 1.0f);
+    bitbuf_pad_to_byte(buf);
+    bitbuf_write_bytes(buf, BYTES, sizeof(BYTES));
+
+    bitbuf_writer_t writer = bitbuf_writer_begin(buf);
+    int             i;
+    for (i = 0; i < 20; i++) {
+        bitbuf_writer_write_n_bits(&writer, 7, (uint64_t)i);
+    }
+    bitbuf_writer_end(&writer);
+    bitbuf_write_n_bits(buf, 3, 5);
+}
+
+static int
+bitbuf__test_measure(void)
+{
+    bitbuf_buffer_t measure = bitbuf_init_measure_buffer();
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(256);
+    size_t          measured_bytes, num_bytes;
+
+    bitbuf__test_write_mixed(&measure);
+    bitbuf__test_write_mixed(&buf);
+
+    TEST(!bitbuf_has_truncated(&measure));
+    TEST(bitbuf_num_bits_written(&measure) == bitbuf_num_bits_written(&buf));
+    TEST(bitbuf_get_bytes_from_buffer(&measure, &measured_bytes) == NULL);
+    bitbuf_get_bytes_from_buffer(&buf, &num_bytes);
+    TEST(measured_bytes == num_bytes);
+
+    // rollback rewinds the count
+    bitbuf_checkpoint_t cp = bitbuf_checkpoint(&measure);
+    bitbuf_write_uint64(&measure, 0);
+    bitbuf_rollback(&measure, &cp);
+    TEST(bitbuf_num_bits_written(&measure) == bitbuf_num_bits_written(&buf));
+
+    bitbuf_free_buffer(&measure);
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_seek(void)
+{
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(32);
+    size_t          block_pos;
+
+    // header, then a component block at a recorded offset
+    bitbuf_write_n_bits(&buf, 5, 0x15);
+    bitbuf_write_uint64(&buf, 0x0123456789ABCDEFull);
+    block_pos = bitbuf_num_bits_written(&buf);
+    bitbuf_write_n_bits(&buf, 13, 0x1ABC);
+    bitbuf_write_uint32(&buf, 0xCAFEF00D);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_cursor_tell_bits(&read) == 0);
+
+    bitbuf_cursor_seek_bits(&read, block_pos);
+    TEST(bitbuf_cursor_tell_bits(&read) == block_pos);
+    TEST(bitbuf_peek_n_bits(&read, 13) == 0x1ABC);
+    TEST(bitbuf_cursor_tell_bits(&read) == block_pos);
+    TEST(bitbuf_read_n_bits(&read, 13, NULL) == 0x1ABC);
+    TEST(bitbuf_read_uint32(&read) == 0xCAFEF00D);
+
+    // backwards, into the middle of the header field
+    bitbuf_cursor_seek_bits(&read, 2);
+    TEST(bitbuf_peek_n_bits(&read, 3) == 0x5);
+    bitbuf_cursor_seek_bits(&read, 5);
+    TEST(bitbuf_peek_n_bits(&read, 64) == 0x0123456789ABCDEFull);
+    TEST(bitbuf_read_uint64(&read) == 0x0123456789ABCDEFull);
+
+    // the end of the buffer is a valid position, past it is not
+    bitbuf_cursor_seek_bits(&read, 32 * 8);
+    TEST(bitbuf_cursor_tell_bits(&read) == 32 * 8);
+    TEST(bitbuf_peek_n_bits(&read, 8) == 0);
+    TEST(!read.read_past_end);
+    bitbuf_cursor_seek_bits(&read, 32 * 8 + 1);
+    TEST(read.read_past_end);
+    TEST(bitbuf_cursor_tell_bits(&read) == 32 * 8);
+    TEST(ftgt_test_errorlevel());
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+static uint64_t
+bitbuf__test_load_le(const uint8_t* bytes, size_t num_bytes)
+{
+    uint64_t value = 0;
+    size_t   i;
+
+    for (i = 0; i < num_bytes; i++) {
+        value |= (uint64_t)bytes[i] << (i * 8);
+    }
+    return value;
+}
+
+static int
+bitbuf__test_unaligned_bytes(void)
+{
+    uint8_t storage[24];
+    size_t  i, num_bytes;
+
+    for (i = 0; i < sizeof(storage); i++) {
+        storage[i] = (uint8_t)(0x30 + i);
+    }
+    memcpy(storage + 3 + 8, "hi", 3);
+
+    // 13 bytes at an odd offset: neither aligned nor a multiple of 8 long
     {
-        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
-        bitbuf_write_uint64(&buf, 0xFF);
+        bitbuf_buffer_t buf = bitbuf_init_buffer_with_bytes(storage + 3, 13);
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        uint8_t         values[8];
+        char            str[8];
+
+        TEST(bitbuf_get_bytes_from_buffer(&buf, &num_bytes) == storage + 3);
+        TEST(num_bytes == 13);
 
+        TEST(bitbuf_peek_n_bits(&read, 16) == (0x33u | 0x34u << 8));
+        bitbuf_read_n_bits_array_uint8(&read, 8, values, 8);
+        for (i = 0; i < 8; i++) {
+            TEST(values[i] == storage[3 + i]);
+        }
+        bitbuf_read_cstr(&read, sizeof(str), str);
+        TEST(strcmp(str, "hi") == 0);
+        TEST(bitbuf_read_uint16(&read) == (uint16_t)(storage[14] | storage[15] << 8));
+        TEST(!read.read_past_end);
+        TEST(bitbuf_cursor_tell_bits(&read) == 13 * 8);
+
+        // the bytes past the slice are never touched
+        bitbuf_read_uint8(&read);
+        TEST(read.read_past_end);
+        TEST(ftgt_test_errorlevel());
+    }
+
+    {
+        bitbuf_buffer_t buf = bitbuf_init_buffer_with_bytes(storage + 1, 11);
+        bitbuf_reader_t reader = bitbuf_reader_init(&buf);
+
+        TEST(bitbuf_reader_read_n_bits(&reader, 64) == bitbuf__test_load_le(storage + 1, 8));
+        TEST(bitbuf_reader_read_n_bits(&reader, 24) == bitbuf__test_load_le(storage + 9, 3));
+        TEST(reader.read_past_end == 0);
+    }
 
+    {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer_with_bytes(storage + 5, 7);
         bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
-        uint64_t        value = bitbuf_read_uint64(&read);
-        TEST(value == 0xFF);
 
+        TEST(bitbuf_read_n_bits(&read, 56, NULL) == bitbuf__test_load_le(storage + 5, 7));
         bitbuf_free_buffer(&buf);
     }
 
-    // read overflow
+    // writes to a zero-copy buffer truncate, leaving its bytes and write
+    // cursor alone.  heap allocated, so a read past the 13 bytes is caught
+    // by sanitizers.
     {
-        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1);
-        bitbuf_write_uint64(&buf, 0xFF);
+        uint8_t*        bytes = (uint8_t*)BITBUF_MALLOC(13);
+        uint8_t         values[1] = {0xff};
+        bitbuf_buffer_t buf;
+        bitbuf_writer_t writer;
 
-        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
-        uint64_t        value;
-        value = bitbuf_read_uint64(&read);
-        TEST(value == 0xFF);
+        memcpy(bytes, storage + 3, 13);
+        buf = bitbuf_init_buffer_with_bytes(bytes, 13);
 
-        // read past end
-        bitbuf_read_uint64(&read);
-        value = bitbuf_read_uint64(&read);
-        TEST(read.read_past_end == 1);
+        writer = bitbuf_writer_begin(&buf);
+        bitbuf_writer_end(&writer);
+        bitbuf_write_n_bits_array_uint8(&buf, 8, values, 0);
+        TEST(!bitbuf_has_truncated(&buf));
+
+        writer = bitbuf_writer_begin(&buf);
+        bitbuf_writer_write_n_bits(&writer, 5, 0x1f);
+        bitbuf_writer_end(&writer);
+        TEST(bitbuf_has_truncated(&buf));
+
+        writer = bitbuf_writer_begin(&buf);
+        bitbuf_writer_write_n_bits(&writer, 64, ~0ull);
+        bitbuf_writer_end(&writer);
+        bitbuf_write_n_bits_array_uint8(&buf, 8, values, 1);
+        bitbuf_write_n_bits(&buf, 3, 0x7);
         TEST(ftgt_test_errorlevel());
-        TEST(value == 0);
 
-        bitbuf_free_buffer(&buf);
+        TEST(bitbuf_num_bits_written(&buf) == 13 * 8);
+        TEST(memcmp(bytes, storage + 3, 13) == 0);
+
+        BITBUF_FREE(bytes);
+    }
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_pool(void)
+{
+    bitbuf_buffer_t bufs[BITBUF_POOL_CACHE_MAX + 4];
+    const uint64_t* recycled;
+    size_t          i, j;
+
+    bitbuf_pool_trim();
+
+    bufs[0] = bitbuf_alloc_pooled_buffer(100);
+    TEST(bufs[0].capacity_bytes == 128);
+    bitbuf_write_uint64(&bufs[0], ~0ull);
+    bitbuf_write_n_bits(&bufs[0], 13, 0x1fff);
+    recycled = bufs[0].data;
+    bitbuf_free_buffer(&bufs[0]);
+
+    // the most recently freed storage comes back, zeroed
+    bufs[0] = bitbuf_alloc_pooled_buffer(65);
+    TEST(bufs[0].data == recycled);
+    for (i = 0; i < 128 / 8; i++) {
+        TEST(bufs[0].data[i] == 0);
+    }
+    TEST(bitbuf_num_bits_written(&bufs[0]) == 0);
+    bitbuf_free_buffer(&bufs[0]);
+
+    // overflow the thread cache into the shared list, and drain it back
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < BITBUF_POOL_CACHE_MAX + 4; i++) {
+            bufs[i] = bitbuf_alloc_pooled_buffer(1200);
+            TEST(bufs[i].capacity_bytes == 2048);
+            TEST(bitbuf_num_bits_written(&bufs[i]) == 0);
+            bitbuf_write_n_bits(&bufs[i], 31, (uint64_t)i * 977 + 1);
+            bitbuf_write_bytes(&bufs[i], (const uint8_t*)"pooled", 6);
+        }
+        for (i = 0; i < BITBUF_POOL_CACHE_MAX + 4; i++) {
+            bitbuf_cursor_t read = bitbuf_cursor_init(&bufs[i]);
+            TEST(bitbuf_read_n_bits(&read, 31, NULL) == (uint64_t)i * 977 + 1);
+            bitbuf_free_buffer(&bufs[i]);
+        }
+    }
+
+    bitbuf_pool_flush_thread_cache();
+    bufs[0] = bitbuf_alloc_pooled_buffer(2048);
+    for (i = 0; i < 2048 / 8; i++) {
+        TEST(bufs[0].data[i] == 0);
+    }
+    bitbuf_free_buffer(&bufs[0]);
+
+    // past the largest size class is a plain allocation
+    bufs[0] = bitbuf_alloc_pooled_buffer(100000);
+    TEST(!bufs[0].pooled);
+    TEST(bufs[0].capacity_bytes >= 100000);
+    bitbuf_free_buffer(&bufs[0]);
+
+    bitbuf_pool_trim();
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_gather(void)
+{
+    bitbuf_buffer_t header = bitbuf_alloc_buffer(8);
+    bitbuf_buffer_t component = bitbuf_alloc_buffer(32);
+    bitbuf_buffer_t empty = bitbuf_alloc_buffer(8);
+    bitbuf_buffer_t trailer = bitbuf_alloc_buffer(8);
+    bitbuf_buffer_t packet = bitbuf_alloc_buffer(32);
+    size_t          i;
+
+    const bitbuf_buffer_t* parts[4] = {&header, &component, &empty, &trailer};
+
+    bitbuf_write_n_bits(&header, 5, 0x15);
+    for (i = 0; i < 10; i++) {
+        bitbuf_write_n_bits(&component, 13, 0x1000 | i);
+    }
+    bitbuf_write_n_bits(&trailer, 3, 0x6);
+
+#ifdef BITBUF_HAS_IOVEC
+    {
+        struct iovec iov[4];
+
+        TEST(bitbuf_export_iovec(parts, 4, iov) == 1 + 17 + 0 + 1);
+        TEST(iov[0].iov_base == (void*)header.data && iov[0].iov_len == 1);
+        TEST(iov[1].iov_base == (void*)component.data && iov[1].iov_len == 17);
+        TEST(iov[2].iov_len == 0);
+        TEST(iov[3].iov_len == 1);
+    }
+#endif
+
+    // a single stream, with no padding at the boundaries
+    bitbuf_write_bool(&packet, true);
+    bitbuf_concat_buffers(&packet, parts, 4);
+    TEST(bitbuf_num_bits_written(&packet) == 1 + 5 + 130 + 3);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&packet);
+    TEST(bitbuf_read_bool(&read));
+    TEST(bitbuf_read_n_bits(&read, 5, NULL) == 0x15);
+    for (i = 0; i < 10; i++) {
+        TEST(bitbuf_read_n_bits(&read, 13, NULL) == (0x1000 | i));
+    }
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == 0x6);
+
+    // too big for the destination: nothing is written
+    {
+        bitbuf_buffer_t small = bitbuf_alloc_buffer(8);
+
+        bitbuf_concat_buffers(&small, parts, 4);
+        TEST(ftgt_test_errorlevel());
+        TEST(bitbuf_num_bits_written(&small) == 0);
+        small.truncated = 0;
+        bitbuf_free_buffer(&small);
+    }
+
+    bitbuf_free_buffer(&header);
+    bitbuf_free_buffer(&component);
+    bitbuf_free_buffer(&empty);
+    bitbuf_free_buffer(&trailer);
+    bitbuf_free_buffer(&packet);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_append(void)
+{
+    bitbuf_buffer_t part = bitbuf_alloc_buffer(64);
+    bitbuf_buffer_t merged = bitbuf_alloc_buffer(128);
+    size_t          i;
+
+    for (i = 0; i < 40; i++) {
+        bitbuf_write_n_bits(&part, 11, (i * 37) & 0x7ff);
+    }
+
+    // at a mid-segment offset, twice, then a slice from a cursor
+    bitbuf_write_n_bits(&merged, 3, 0x5);
+    bitbuf_append_buffer(&merged, &part);
+    bitbuf_append_buffer(&merged, &part);
+    {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&part);
+
+        bitbuf_cursor_seek_bits(&read, 11 * 7 + 4);
+        bitbuf_append_bits(&merged, &read, 11 * 6 + 65);
+        TEST(bitbuf_cursor_tell_bits(&read) == 11 * 13 + 69);
+
+        bitbuf_append_bits(&merged, &read, 40 * 11);
+        TEST(read.read_past_end);
+        TEST(ftgt_test_errorlevel());
+    }
+    TEST(bitbuf_num_bits_written(&merged) == 3 + 2 * 440 + 131);
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&merged);
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == 0x5);
+    for (i = 0; i < 80; i++) {
+        TEST(bitbuf_read_n_bits(&read, 11, NULL) == ((i % 40) * 37 & 0x7ff));
+    }
+    TEST(bitbuf_read_n_bits(&read, 7, NULL) == ((7 * 37 & 0x7ff) >> 4));
+    for (i = 8; i < 14; i++) {
+        TEST(bitbuf_read_n_bits(&read, 11, NULL) == (i * 37 & 0x7ff));
+    }
+    for (; i < 19; i++) {
+        TEST(bitbuf_read_n_bits(&read, 11, NULL) == (i * 37 & 0x7ff));
+    }
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == (19 * 37 & 0x7));
+
+    bitbuf_free_buffer(&part);
+    bitbuf_free_buffer(&merged);
+
+    return ftgt_test_errorlevel();
+}
+
+static int
+bitbuf__test_fragment(void)
+{
+    static const int ORDER[8] = {3, 7, 0, 5, 1, 6, 2, 4};
+
+    bitbuf_buffer_t     message = bitbuf_alloc_buffer(128);
+    bitbuf_buffer_t     dest = bitbuf_alloc_buffer(128);
+    bitbuf_buffer_t     gathered = bitbuf_alloc_buffer(128);
+    bitbuf_fragmenter_t frag;
+    size_t              i;
+
+    for (i = 0; i < 90; i++) {
+        bitbuf_write_n_bits(&message, 11, (i * 53) & 0x7ff);
+    }
+    bitbuf_write_n_bits(&message, 10, 0x2aa);
+
+    // 128 payload bits per fragment, 104 in the last
+    frag = bitbuf_fragmenter_init(&message, 0xbeef, 16);
+    TEST(frag.num_fragments == 8);
+
+    bitbuf_reassembler_t reasm = bitbuf_reassembler_init(&dest);
+    bitbuf_reassembler_t reasm_gathered = bitbuf_reassembler_init(&gathered);
+
+    for (i = 0; i < 8; i++) {
+        bitbuf_buffer_t packet = bitbuf_alloc_buffer(32);
+        bitbuf_cursor_t read;
+
+        // a fragment after other data in the packet
+        bitbuf_write_n_bits(&packet, 3, 0x5);
+        bitbuf_write_fragment(&packet, &frag, ORDER[i]);
+
+        read = bitbuf_cursor_init(&packet);
+        TEST(bitbuf_read_n_bits(&read, 3, NULL) == 0x5);
+        TEST(!bitbuf_reassembler_is_complete(&reasm));
+        TEST(bitbuf_reassembler_add(&reasm, &read));
+        TEST(bitbuf_cursor_tell_bits(&read) == bitbuf_num_bits_written(&packet));
+
+        // duplicates are rejected and skipped
+        bitbuf_cursor_seek_bits(&read, 3);
+        TEST(!bitbuf_reassembler_add(&reasm, &read));
+        TEST(bitbuf_cursor_tell_bits(&read) == bitbuf_num_bits_written(&packet));
+
+        bitbuf_free_buffer(&packet);
+    }
+    TEST(bitbuf_reassembler_is_complete(&reasm));
+    TEST(bitbuf_num_bits_written(&dest) == 1000);
+
+    // header plus a view of the payload, as sent with bitbuf_export_iovec
+    for (i = 0; i < 8; i++) {
+        bitbuf_buffer_t header = bitbuf_alloc_buffer(16);
+        bitbuf_buffer_t payload = bitbuf_fragment_payload(&frag, ORDER[i]);
+        bitbuf_buffer_t packet = bitbuf_alloc_buffer(32);
+        bitbuf_cursor_t read;
+
+        const bitbuf_buffer_t* parts[2] = {&header, &payload};
+
+        bitbuf_write_fragment_header(&header, &frag, ORDER[i]);
+        bitbuf_concat_buffers(&packet, parts, 2);
+
+        // payload views are empty on big-endian targets
+        if (!BITBUF__LITTLE_ENDIAN) {
+            TEST(bitbuf_num_bits_written(&payload) == 0);
+            bitbuf_free_buffer(&packet);
+            packet = bitbuf_alloc_buffer(32);
+            bitbuf_write_fragment(&packet, &frag, ORDER[i]);
+        }
+
+        read = bitbuf_cursor_init(&packet);
+        TEST(bitbuf_reassembler_add(&reasm_gathered, &read));
+
+        bitbuf_free_buffer(&header);
+        bitbuf_free_buffer(&packet);
+    }
+    TEST(bitbuf_reassembler_is_complete(&reasm_gathered));
+
+    {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&dest);
+        bitbuf_cursor_t read_gathered = bitbuf_cursor_init(&gathered);
+
+        for (i = 0; i < 90; i++) {
+            TEST(bitbuf_read_n_bits(&read, 11, NULL) == ((i * 53) & 0x7ff));
+            TEST(bitbuf_read_n_bits(&read_gathered, 11, NULL) == ((i * 53) & 0x7ff));
+        }
+        TEST(bitbuf_read_n_bits(&read, 10, NULL) == 0x2aa);
+        TEST(bitbuf_read_n_bits(&read_gathered, 10, NULL) == 0x2aa);
+    }
+
+    // fragments of another message are rejected
+    {
+        bitbuf_fragmenter_t other = bitbuf_fragmenter_init(&message, 0xf00d, 16);
+        bitbuf_buffer_t     packet = bitbuf_alloc_buffer(96);
+        bitbuf_buffer_t     small = bitbuf_alloc_buffer(64);
+        bitbuf_cursor_t     read;
+
+        reasm = bitbuf_reassembler_init(&small);
+        bitbuf_write_fragment(&packet, &frag, 1);
+        bitbuf_write_fragment(&packet, &other, 2);
+        bitbuf_write_fragment(&packet, &frag, 4);
+
+        read = bitbuf_cursor_init(&packet);
+        TEST(bitbuf_reassembler_add(&reasm, &read));
+        TEST(!bitbuf_reassembler_add(&reasm, &read));
+
+        // past the end of the destination
+        TEST(!bitbuf_reassembler_add(&reasm, &read));
+        TEST(reasm.num_received == 1);
+
+        bitbuf_free_buffer(&packet);
+        bitbuf_free_buffer(&small);
+    }
+
+    // a fragment read after an earlier failed read
+    {
+        bitbuf_buffer_t packet = bitbuf_alloc_buffer(32);
+        bitbuf_buffer_t small = bitbuf_alloc_buffer(128);
+        bitbuf_cursor_t read;
+
+        reasm = bitbuf_reassembler_init(&small);
+        bitbuf_write_fragment(&packet, &frag, 2);
+        read = bitbuf_cursor_init(&packet);
+        bitbuf_cursor_seek_bits(&read, 32 * 8 - 4);
+        bitbuf_read_n_bits(&read, 5, NULL);
+        TEST(read.read_past_end);
+        TEST(ftgt_test_errorlevel());
+
+        bitbuf_cursor_seek_bits(&read, 0);
+        TEST(bitbuf_reassembler_add(&reasm, &read));
+        TEST(read.read_past_end);
+
+        bitbuf_free_buffer(&packet);
+        bitbuf_free_buffer(&small);
+    }
+
+    // a pooled destination abandoned with the message incomplete goes
+    // back to the pool cleared
+    {
+        bitbuf_buffer_t packet = bitbuf_alloc_buffer(32);
+        bitbuf_buffer_t pooled = bitbuf_alloc_pooled_buffer(128);
+        bitbuf_cursor_t read;
+        uint8_t         bytes[100];
+
+        reasm = bitbuf_reassembler_init(&pooled);
+        bitbuf_write_fragment(&packet, &frag, 5);
+        read = bitbuf_cursor_init(&packet);
+        TEST(bitbuf_reassembler_add(&reasm, &read));
+        TEST(!bitbuf_reassembler_is_complete(&reasm));
+        bitbuf_free_buffer(&pooled);
+
+        pooled = bitbuf_alloc_pooled_buffer(128);
+        for (i = 0; i < 100; i++) {
+            bitbuf_write_uint8(&pooled, 0);
+        }
+        read = bitbuf_cursor_init(&pooled);
+        bitbuf_read_bytes(&read, bytes, 100);
+        for (i = 0; i < 100; i++) {
+            TEST(bytes[i] == 0);
+        }
+
+        bitbuf_free_buffer(&packet);
+        bitbuf_free_buffer(&pooled);
     }
 
+    bitbuf_free_buffer(&message);
+    bitbuf_free_buffer(&dest);
+    bitbuf_free_buffer(&gathered);
+
     return ftgt_test_errorlevel();
 }
 
 static int
-bitbuf__test_align_to_end_of_segment(void)
+bitbuf__test_range_coder(void)
 {
-    bitbuf_buffer_t buf = bitbuf_alloc_buffer(16);
+    bitbuf_buffer_t        buf = bitbuf_alloc_buffer(1024);
+    bitbuf_prob_t          flag_prob, kind_probs[8], count_probs[BITBUF_RANGE_UINT_PROBS];
+    bitbuf_range_encoder_t enc;
+    bitbuf_range_decoder_t dec;
+    size_t                 coded_bits;
+    int                    i;
+
+    bitbuf_init_probs(&flag_prob, 1);
+    bitbuf_init_probs(kind_probs, 8);
+    bitbuf_init_probs(count_probs, BITBUF_RANGE_UINT_PROBS);
+
+    // a header bit, then 1000 bools that are 5% true, 3-bit enums that
+    // are mostly 2, and small counts
+    bitbuf_write_bool(&buf, true);
+    enc = bitbuf_range_encoder_begin(&buf);
+    for (i = 0; i < 1000; i++) {
+        bitbuf_range_encode_bit(&enc, &flag_prob, i % 20 == 7);
+        bitbuf_range_encode_symbol(&enc, kind_probs, 3, i % 10 == 3 ? 5 : 2);
+        bitbuf_range_encode_uint(&enc, count_probs, (uint64_t)(i % 4));
+    }
+    bitbuf_range_encode_uint(&enc, count_probs, ~0ull);
+    bitbuf_range_encode_direct(&enc, 13, 0x1234);
+    bitbuf_range_encoder_end(&enc);
+    bitbuf_write_n_bits(&buf, 5, 0x11);
 
-    uint64_t BIG = 0x7FFFFFFFFFFFFFFFull;
+    coded_bits = bitbuf_num_bits_written(&buf) - 6;
+    TEST(!bitbuf_has_truncated(&buf));
+    TEST(coded_bits < 1000 * (1 + 3 + 2) * 6 / 10);
 
-    bitbuf_write_n_bits(&buf, 63, BIG);
-    bitbuf_pad_to_byte(&buf);
-    bitbuf_write_int32(&buf, -500000);
+    bitbuf_init_probs(&flag_prob, 1);
+    bitbuf_init_probs(kind_probs, 8);
+    bitbuf_init_probs(count_probs, BITBUF_RANGE_UINT_PROBS);
 
     bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_bool(&read));
+    dec = bitbuf_range_decoder_begin(&read);
+    for (i = 0; i < 1000; i++) {
+        TEST(bitbuf_range_decode_bit(&dec, &flag_prob) == (i % 20 == 7));
+        TEST(bitbuf_range_decode_symbol(&dec, kind_probs, 3) == (i % 10 == 3 ? 5u : 2u));
+        TEST(bitbuf_range_decode_uint(&dec, count_probs) == (uint64_t)(i % 4));
+    }
+    TEST(bitbuf_range_decode_uint(&dec, count_probs) == ~0ull);
+    TEST(bitbuf_range_decode_direct(&dec, 13) == 0x1234);
 
-    uint64_t value = bitbuf_read_n_bits(&read, 63, NULL);
-    TEST(value == BIG);
-
-    bitbuf_skip_byte_padding(&read);
-    TEST(bitbuf_read_int32(&read) == -500000);
+    // the decoder stops at the end of the coded bytes
+    TEST(bitbuf_read_n_bits(&read, 5, NULL) == 0x11);
+    TEST(bitbuf_cursor_tell_bits(&read) == bitbuf_num_bits_written(&buf));
 
     bitbuf_free_buffer(&buf);
 
@@ -972,172 +7440,792 @@ bitbuf__test_align_to_end_of_segment(void)
 }
 
 static int
-bitbuf__test_write_after_read(void)
+bitbuf__test_rans(void)
 {
-    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(4096);
+    uint8_t         bytes[1003], out[1003];
+    size_t          i, num_bits;
 
-    bitbuf_cursor_init(buf);
-    bitbuf_write_bool(buf, false);
+    // mostly small values, and a count that does not fill all lanes
+    for (i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(i % 7 == 0 ? (i * 31) & 0x3f : i % 3);
+    }
+
+    bitbuf_write_n_bits(&buf, 3, 0x5);
+    bitbuf_write_rans_bytes(&buf, bytes, sizeof(bytes));
+    num_bits = bitbuf_num_bits_written(&buf);
+    TEST(num_bits < sizeof(bytes) * 8 / 2);
+
+    bitbuf_write_rans_bytes(&buf, bytes, 0);
+    bitbuf_write_rans_bytes(&buf, bytes + 1, 1);
+    bitbuf_write_bool(&buf, true);
 
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == 0x5);
+    TEST(bitbuf_read_rans_bytes(&read, out, sizeof(out)) == sizeof(bytes));
+    TEST(memcmp(bytes, out, sizeof(bytes)) == 0);
+    TEST(bitbuf_read_rans_bytes(&read, out, sizeof(out)) == 0);
+    TEST(bitbuf_read_rans_bytes(&read, out, sizeof(out)) == 1 && out[0] == bytes[1]);
+    TEST(bitbuf_read_bool(&read));
+    TEST(!read.read_past_end);
+
+    // a block larger than the output is refused
+    read = bitbuf_cursor_init(&buf);
+    bitbuf_read_n_bits(&read, 3, NULL);
+    TEST(bitbuf_read_rans_bytes(&read, out, 1000) == 0);
+    TEST(read.read_past_end);
     TEST(ftgt_test_errorlevel());
 
+    // and does not fail a later read of it
+    bitbuf_cursor_seek_bits(&read, 3);
+    TEST(bitbuf_read_rans_bytes(&read, out, sizeof(out)) == sizeof(bytes));
+    TEST(memcmp(bytes, out, sizeof(bytes)) == 0);
+    TEST(read.read_past_end);
+
+    bitbuf_free_buffer(&buf);
+
     return ftgt_test_errorlevel();
 }
 
 static int
-bitbuf__test_crop_set_bit_on_n_write(void)
+bitbuf__test_universal(void)
 {
-    bitbuf_write_n_bits(&bitbuf__tv.buf, 1, 3);
+    const uint64_t VALUES[] = {0, 1, 2, 5, 63, 64, 1000, 0xFFFFFFFFull, UINT64_MAX - 1};
+    const int      NUM_VALUES = (int)(sizeof(VALUES) / sizeof(VALUES[0]));
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(2048);
+    int             i;
+
+    // rice with a zero run longer than a segment
+    bitbuf_write_rice(&buf, 2, 5);
+    TEST(bitbuf_num_bits_written(&buf) == 4);
+    bitbuf_write_rice(&buf, 0, 0);
+    bitbuf_write_rice(&buf, 3, 1000);
+    bitbuf_write_rice(&buf, 63, UINT64_MAX);
+    for (i = 0; i < NUM_VALUES; i++) {
+        bitbuf_write_elias_gamma(&buf, VALUES[i]);
+        bitbuf_write_elias_delta(&buf, VALUES[i]);
+    }
+    bitbuf_write_bool(&buf, true);
+    TEST(!bitbuf_has_truncated(&buf));
+
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_rice(&read, 2) == 5);
+    TEST(bitbuf_read_rice(&read, 0) == 0);
+    TEST(bitbuf_read_rice(&read, 3) == 1000);
+    TEST(bitbuf_read_rice(&read, 63) == UINT64_MAX);
+    for (i = 0; i < NUM_VALUES; i++) {
+        TEST(bitbuf_read_elias_gamma(&read) == VALUES[i]);
+        TEST(bitbuf_read_elias_delta(&read) == VALUES[i]);
+    }
+    TEST(bitbuf_read_bool(&read));
+    TEST(!read.read_past_end);
+
+    bitbuf_reader_t reader = bitbuf_reader_init(&buf);
+    TEST(bitbuf_reader_read_rice(&reader, 2) == 5);
+    TEST(bitbuf_reader_read_rice(&reader, 0) == 0);
+    TEST(bitbuf_reader_read_rice(&reader, 3) == 1000);
+    TEST(bitbuf_reader_read_rice(&reader, 63) == UINT64_MAX);
+    for (i = 0; i < NUM_VALUES; i++) {
+        TEST(bitbuf_reader_read_elias_gamma(&reader) == VALUES[i]);
+        TEST(bitbuf_reader_read_elias_delta(&reader) == VALUES[i]);
+    }
+    TEST(bitbuf_reader_read_n_bits(&reader, 1) == 1);
+    TEST(!reader.read_past_end);
+
+    bitbuf_free_buffer(&buf);
+
+    // gamma: 2 * 3 + 1 bits for 9.  a zero run reaching the end of the
+    // buffer is refused.
+    buf = bitbuf_alloc_buffer(16);
+    bitbuf_write_elias_gamma(&buf, 8);
+    TEST(bitbuf_num_bits_written(&buf) == 7);
+    bitbuf_write_n_bits(&buf, 64, 0);
+
+    read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_elias_gamma(&read) == 8);
+    TEST(bitbuf_read_rice(&read, 4) == 0);
+    TEST(read.read_past_end);
+
+    reader = bitbuf_reader_init(&buf);
+    TEST(bitbuf_reader_read_elias_gamma(&reader) == 8);
+    TEST(bitbuf_reader_read_elias_delta(&reader) == 0);
+    TEST(reader.read_past_end);
+
+    // codes that do not fit are refused whole: a long rice run, and a
+    // delta code whose bits would not fit after its length.  codes that
+    // fit are still written after truncation, as with other writes.
+    bitbuf_write_rice(&buf, 0, 100);
+    TEST(bitbuf_has_truncated(&buf));
+    TEST(bitbuf_num_bits_written(&buf) == 71);
+    bitbuf_write_rice(&buf, 0, 1);
+    TEST(bitbuf_num_bits_written(&buf) == 73);
+    bitbuf_write_elias_delta(&buf, UINT64_MAX - 1);
+    TEST(bitbuf_num_bits_written(&buf) == 73);
+    bitbuf_free_buffer(&buf);
+
+    // a growable buffer is grown once for a long run, but not for one
+    // over the limit
+    buf = bitbuf_alloc_growable_buffer(8);
+    bitbuf_write_rice(&buf, 0, 1000);
+    TEST(!bitbuf_has_truncated(&buf));
+    TEST(bitbuf_num_bits_written(&buf) == 1001);
+    bitbuf_write_rice(&buf, 0, 1ull << 40);
+    TEST(bitbuf_has_truncated(&buf));
+    TEST(bitbuf_num_bits_written(&buf) == 1001);
+    TEST(ftgt_test_errorlevel());
+
+    read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_rice(&read, 0) == 1000);
+    bitbuf_free_buffer(&buf);
+
+    // measuring counts a long code like any other
+    buf = bitbuf_init_measure_buffer();
+    bitbuf_write_rice(&buf, 2, 4000);
+    TEST(bitbuf_num_bits_written(&buf) == 1003);
+    bitbuf_write_elias_delta(&buf, 1000);
+    TEST(bitbuf_num_bits_written(&buf) == 1003 + 7 + 9);
+
+    // a failed read leaves read_past_end set, which does not fail later
+    // reads of whole codes
+    buf = bitbuf_alloc_buffer(16);
+    bitbuf_write_elias_gamma(&buf, 41);
+    bitbuf_write_rice(&buf, 3, 77);
+    bitbuf_write_elias_delta(&buf, 1000);
+    bitbuf_write_bool(&buf, true);
+
+    read = bitbuf_cursor_init(&buf);
+    bitbuf_cursor_seek_bits(&read, bitbuf_num_bits_written(&buf));
+    TEST(bitbuf_read_elias_gamma(&read) == 0);
+    TEST(read.read_past_end);
     TEST(ftgt_test_errorlevel());
 
+    bitbuf_cursor_seek_bits(&read, 0);
+    reader = bitbuf_reader_init_at(&read);
+    TEST(reader.read_past_end);
+    TEST(bitbuf_read_elias_gamma(&read) == 41);
+    TEST(bitbuf_read_rice(&read, 3) == 77);
+    TEST(bitbuf_read_elias_delta(&read) == 1000);
+    TEST(bitbuf_read_bool(&read));
+    TEST(bitbuf_reader_read_elias_gamma(&reader) == 41);
+    TEST(bitbuf_reader_read_rice(&reader, 3) == 77);
+    TEST(bitbuf_reader_read_elias_delta(&reader) == 1000);
+    TEST(bitbuf_reader_read_n_bits(&reader, 1) == 1);
+    bitbuf_free_buffer(&buf);
+
     return ftgt_test_errorlevel();
 }
 
 static int
-bitbuf__test_cstr_overflow(void)
+bitbuf__test_elias_fano(void)
 {
-    bitbuf_buffer_t buf = bitbuf_alloc_buffer(5);
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(2048);
+    uint64_t        ids[500];
+    uint64_t        value;
+    size_t          i, num_bits;
+
+    // sorted ids with gaps of 1..64, including repeats
+    ids[0] = 3;
+    for (i = 1; i < 500; i++) {
+        ids[i] = ids[i - 1] + (i * 37) % 64;
+    }
 
-    // implementation detail dependency
-    TEST(buf.capacity_bytes == 8);
+    bitbuf_write_n_bits(&buf, 5, 0x11);
+    bitbuf_write_elias_fano(&buf, ids, 500);
+    num_bits = bitbuf_num_bits_written(&buf) - 5;
+    TEST(num_bits < 500 * 8);
+    bitbuf_write_elias_fano(&buf, ids, 0);
+    bitbuf_write_elias_fano(&buf, ids + 10, 1);
+    bitbuf_write_bool(&buf, true);
+    TEST(!bitbuf_has_truncated(&buf));
 
-    // catch assert for overflow on null terminator
-    bitbuf_write_cstr(&buf, "abcdefgh");
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_n_bits(&read, 5, NULL) == 0x11);
+    bitbuf_elias_fano_t ef = bitbuf_read_elias_fano(&read);
+    TEST(ef.count == 500);
+
+    bitbuf_elias_fano_t empty = bitbuf_read_elias_fano(&read);
+    TEST(!bitbuf_elias_fano_next(&empty, &value));
+    bitbuf_elias_fano_t one = bitbuf_read_elias_fano(&read);
+    TEST(bitbuf_elias_fano_next(&one, &value) && value == ids[10]);
+    TEST(!bitbuf_elias_fano_next(&one, &value));
+    TEST(bitbuf_read_bool(&read));
+    TEST(!read.read_past_end);
+
+    bitbuf_elias_fano_t iter = ef;
+    for (i = 0; i < 500; i++) {
+        TEST(bitbuf_elias_fano_next(&iter, &value) && value == ids[i]);
+        TEST(bitbuf_elias_fano_get(&ef, i) == ids[i]);
+    }
+    TEST(!bitbuf_elias_fano_next(&iter, &value));
+
+    // skip forward, to a present id, an absent one, and past the end
+    iter = ef;
+    TEST(bitbuf_elias_fano_next_geq(&iter, 0, &value) && value == ids[0]);
+    TEST(bitbuf_elias_fano_next_geq(&iter, ids[300], &value) && value == ids[300]);
+    TEST(iter.index == 301 || ids[300] == ids[301]);
+    TEST(bitbuf_elias_fano_next_geq(&iter, ids[400] + 1, &value) && value > ids[400]);
+    TEST(bitbuf_elias_fano_next(&iter, &value) && value >= ids[401]);
+    TEST(!bitbuf_elias_fano_next_geq(&iter, ids[499] + 1, &value));
+
+    // an earlier failed read does not fail a later block
+    bitbuf_cursor_seek_bits(&read, 2048 * 8 - 4);
+    bitbuf_read_n_bits(&read, 5, NULL);
+    TEST(read.read_past_end);
+    bitbuf_cursor_seek_bits(&read, 5);
+    TEST(bitbuf_read_elias_fano(&read).count == 500);
+    TEST(bitbuf_read_elias_fano(&read).count == 0);
+    TEST(bitbuf_read_elias_fano(&read).count == 1);
+    TEST(bitbuf_read_bool(&read));
+
+    bitbuf_free_buffer(&buf);
 
+    // unsorted values are refused, and a block cut short is malformed
+    buf = bitbuf_alloc_buffer(8);
+    ids[0] = 10;
+    ids[1] = 5;
+    bitbuf_write_elias_fano(&buf, ids, 2);
+    bitbuf_write_varint_u64(&buf, 7, 100);
+    bitbuf_write_n_bits(&buf, 6, 2);
+    bitbuf_write_varint_u64(&buf, 7, 100);
+
+    read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_elias_fano(&read).count == 0);
+    TEST(!read.read_past_end);
+    TEST(bitbuf_read_elias_fano(&read).count == 0);
+    TEST(read.read_past_end);
     TEST(ftgt_test_errorlevel());
-    TEST(bitbuf_has_truncated(&buf));
+
     bitbuf_free_buffer(&buf);
 
     return ftgt_test_errorlevel();
 }
 
 static int
-bitbuf__test_read_buffers(void)
+bitbuf__test_pfor(void)
 {
-    const char STR[] = "abcdefgh";
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(16384);
+    uint32_t        values[300], out[300];
+    size_t          i, num_bits;
+
+    // tick stamps: close together, with a few far outliers, and a
+    // count that leaves a partial final block
+    for (i = 0; i < 300; i++) {
+        values[i] = 1000000 + (uint32_t)((i * 7) % 50);
+    }
+    values[5] += 1u << 20;
+    values[200] = 0xffffffffu;
 
-    {
-        size_t i;
-        bitbuf_buffer_t buf =
-            bitbuf_alloc_buffer_with_bytes((uint8_t*)STR, strlen(STR));
-        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    bitbuf_write_n_bits(&buf, 3, 0x5);
+    bitbuf_write_pfor_u32(&buf, values, 300);
+    num_bits = bitbuf_num_bits_written(&buf);
+    TEST(num_bits < sizeof(values) * 8 / 3);
 
-        for (i = 0; i < strlen(STR); i++) {
-            TEST(bitbuf_read_uint8(&read) == (uint8_t)STR[i]);
+    bitbuf_write_pfor_u32(&buf, values, 0);
+    bitbuf_write_pfor_u32(&buf, values + 10, 1);
+    TEST(!bitbuf_has_truncated(&buf));
+
+    // every width, each with an exception
+    for (i = 0; i <= 32; i++) {
+        uint32_t block[BITBUF_PFOR_BLOCK];
+        size_t   j;
+
+        for (j = 0; j < BITBUF_PFOR_BLOCK; j++) {
+            block[j] = 7 + (uint32_t)(bitbuf__low_mask((int)i) & (j * 0x9e3779b9u));
         }
+        block[i] = 0xfffffff0u;
+        bitbuf_write_pfor_u32(&buf, block, BITBUF_PFOR_BLOCK);
+    }
+    bitbuf_write_bool(&buf, true);
+    TEST(!bitbuf_has_truncated(&buf));
 
-        bitbuf_free_buffer(&buf);
+    bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    TEST(bitbuf_read_n_bits(&read, 3, NULL) == 0x5);
+    TEST(bitbuf_read_pfor_u32(&read, out, 300) == 300);
+    TEST(memcmp(values, out, sizeof(values)) == 0);
+    TEST(bitbuf_read_pfor_u32(&read, out, 300) == 0);
+    TEST(bitbuf_read_pfor_u32(&read, out, 300) == 1 && out[0] == values[10]);
+
+    for (i = 0; i <= 32; i++) {
+        size_t j;
+        bool   same = true;
+
+        TEST(bitbuf_read_pfor_u32(&read, out, 300) == BITBUF_PFOR_BLOCK);
+        for (j = 0; j < BITBUF_PFOR_BLOCK; j++) {
+            uint32_t expect = 7 + (uint32_t)(bitbuf__low_mask((int)i) & (j * 0x9e3779b9u));
+            same &= out[j] == (j == i ? 0xfffffff0u : expect);
+        }
+        TEST(same);
+    }
+    TEST(bitbuf_read_bool(&read));
+    TEST(!read.read_past_end);
+
+    // an array larger than the output is refused
+    read = bitbuf_cursor_init(&buf);
+    bitbuf_read_n_bits(&read, 3, NULL);
+    TEST(bitbuf_read_pfor_u32(&read, out, 299) == 0);
+    TEST(read.read_past_end);
+    TEST(ftgt_test_errorlevel());
 
-        return ftgt_test_errorlevel();
+    // and does not fail a later read of it
+    bitbuf_cursor_seek_bits(&read, 3);
+    TEST(bitbuf_read_pfor_u32(&read, out, 300) == 300);
+    TEST(memcmp(values, out, sizeof(values)) == 0);
+    TEST(read.read_past_end);
+
+    bitbuf_free_buffer(&buf);
+
+    return ftgt_test_errorlevel();
+}
+
+BITBUFDEF
+void
+bitbuf_decl_suite(void)
+{
+    ftgt_suite_s* suite = ftgt_create_suite(
+        NULL, "bitbuf_core", bitbuf__test_setup, bitbuf__test_teardown);
+    FTGT_ADD_TEST(suite, bitbuf__test_basic);
+    FTGT_ADD_TEST(suite, bitbuf__test_buffer_overflow);
+    FTGT_ADD_TEST(suite, bitbuf__test_align_to_end_of_segment);
+    FTGT_ADD_TEST(suite, bitbuf__test_write_after_read);
+    FTGT_ADD_TEST(suite, bitbuf__test_crop_set_bit_on_n_write);
+    FTGT_ADD_TEST(suite, bitbuf__test_cstr_overflow);
+    FTGT_ADD_TEST(suite, bitbuf__test_read_buffers);
+    FTGT_ADD_TEST(suite, bitbuf__test_qfloat);
+    FTGT_ADD_TEST(suite, bitbuf__test_get_bytes_from_buffer);
+    FTGT_ADD_TEST(suite, bitbuf__test_growable);
+    FTGT_ADD_TEST(suite, bitbuf__test_writer);
+    FTGT_ADD_TEST(suite, bitbuf__test_reader);
+    FTGT_ADD_TEST(suite, bitbuf__test_arrays);
+    FTGT_ADD_TEST(suite, bitbuf__test_bytes);
+    FTGT_ADD_TEST(suite, bitbuf__test_views);
+    FTGT_ADD_TEST(suite, bitbuf__test_varint);
+    FTGT_ADD_TEST(suite, bitbuf__test_ranged_int);
+    FTGT_ADD_TEST(suite, bitbuf__test_delta);
+    FTGT_ADD_TEST(suite, bitbuf__test_vec3_quat);
+    FTGT_ADD_TEST(suite, bitbuf__test_quantized_float_array);
+    FTGT_ADD_TEST(suite, bitbuf__test_half_bfloat16);
+    FTGT_ADD_TEST(suite, bitbuf__test_checkpoint);
+    FTGT_ADD_TEST(suite, bitbuf__test_measure);
+    FTGT_ADD_TEST(suite, bitbuf__test_seek);
+    FTGT_ADD_TEST(suite, bitbuf__test_unaligned_bytes);
+    FTGT_ADD_TEST(suite, bitbuf__test_pool);
+    FTGT_ADD_TEST(suite, bitbuf__test_gather);
+    FTGT_ADD_TEST(suite, bitbuf__test_append);
+    FTGT_ADD_TEST(suite, bitbuf__test_fragment);
+    FTGT_ADD_TEST(suite, bitbuf__test_range_coder);
+    FTGT_ADD_TEST(suite, bitbuf__test_rans);
+    FTGT_ADD_TEST(suite, bitbuf__test_universal);
+    FTGT_ADD_TEST(suite, bitbuf__test_elias_fano);
+    FTGT_ADD_TEST(suite, bitbuf__test_pfor);
+}
+
+#endif /* FTGT_TESTS_ENABLED */
+
+// benchmarks follow -- compare fast paths against the general purpose
+// routines.  Build with optimizations on.
+#ifdef BITBUF_BENCHMARKS_ENABLED
+
+#include <stdio.h>
+#include <time.h>
+
+#define BITBUF__BENCH_FIELDS (1 << 20)
+#define BITBUF__BENCH_PASSES 32
+
+static const int bitbuf__bench_widths[4] = {1, 7, 13, 32};
+
+static void
+bitbuf__bench_report(const char* name, clock_t start, size_t num_fields)
+{
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%-48s %7.2f ns/field\n", name, secs * 1e9 / (double)num_fields);
+}
+
+// rewind a buffer's write cursor so it can be written again
+static void
+bitbuf__bench_rewind(bitbuf_buffer_t* buf)
+{
+    memset(buf->data, 0, buf->capacity_bytes);
+    buf->write.seg = buf->data;
+    buf->write.bits_into_seg = 0;
+}
+
+static void
+bitbuf__bench_write(void)
+{
+    const size_t    TOTAL = (size_t)BITBUF__BENCH_FIELDS * BITBUF__BENCH_PASSES;
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(BITBUF__BENCH_FIELDS * 4 + 8);
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            bitbuf_write_n_bits(&buf, 11, i & 0x7ff);
+        }
+    }
+    bitbuf__bench_report("write 11-bit fields, bitbuf_write_n_bits", start, TOTAL);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_writer_t writer = bitbuf_writer_begin(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            bitbuf_writer_write_n_bits(&writer, 11, i & 0x7ff);
+        }
+        bitbuf_writer_end(&writer);
     }
+    bitbuf__bench_report("write 11-bit fields, bitbuf_writer_t", start, TOTAL);
 
     {
-        size_t i;
-        bitbuf_buffer_t buf =
-            bitbuf_init_buffer_with_bytes((uint8_t*)STR, strlen(STR));
-        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        uint16_t* ids = (uint16_t*)BITBUF_MALLOC(BITBUF__BENCH_FIELDS * sizeof(uint16_t));
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            ids[i] = (uint16_t)(i & 0x7ff);
+        }
 
-        for (i = 0; i < strlen(STR); i++) {
-            TEST(bitbuf_read_uint8(&read) == (uint8_t)STR[i]);
+        start = clock();
+        for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+            bitbuf__bench_rewind(&buf);
+            bitbuf_write_n_bits_array_uint16(&buf, 11, ids, BITBUF__BENCH_FIELDS);
         }
+        bitbuf__bench_report("write 11-bit fields, bitbuf_write_n_bits_array", start, TOTAL);
 
-        return ftgt_test_errorlevel();
+        start = clock();
+        for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+            bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+            bitbuf_read_n_bits_array_uint16(&read, 11, ids, BITBUF__BENCH_FIELDS);
+
+            // allow the buffer to be rewound and written again
+            buf.write.owner = NULL;
+        }
+        bitbuf__bench_report("read 11-bit fields, bitbuf_read_n_bits_array", start, TOTAL);
+
+        BITBUF_FREE(ids);
     }
-}
 
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            int num_bits = bitbuf__bench_widths[i & 3];
+            bitbuf_write_n_bits(&buf, num_bits, i & bitbuf__spanmasktable[num_bits]);
+        }
+    }
+    bitbuf__bench_report("write mixed width fields, bitbuf_write_n_bits", start, TOTAL);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_writer_t writer = bitbuf_writer_begin(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            int num_bits = bitbuf__bench_widths[i & 3];
+            bitbuf_writer_write_n_bits(&writer, num_bits, i & bitbuf__spanmasktable[num_bits]);
+        }
+        bitbuf_writer_end(&writer);
+    }
+    bitbuf__bench_report("write mixed width fields, bitbuf_writer_t", start, TOTAL);
 
-static int
-bitbuf__test_qfloat(void)
+    BITBUF__ASSERT(!bitbuf_has_truncated(&buf));
+    bitbuf_free_buffer(&buf);
+}
+
+static void
+bitbuf__bench_read(void)
 {
-    const int    STORE_BITS[] = {4, 8, 16, 24, 31};
-    const size_t STORE_BITS_LEN = sizeof(STORE_BITS) / sizeof(STORE_BITS[0]);
-    size_t i;
+    const size_t    TOTAL = (size_t)BITBUF__BENCH_FIELDS * BITBUF__BENCH_PASSES;
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(BITBUF__BENCH_FIELDS * 4 + 8);
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    // volatile to keep reads from being optimized out
+    volatile uint64_t sink = 0;
+
+    for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+        int num_bits = bitbuf__bench_widths[i & 3];
+        bitbuf_write_n_bits(&buf, num_bits, i & bitbuf__spanmasktable[num_bits]);
+    }
 
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        uint64_t        sum = 0;
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            sum += bitbuf_read_n_bits(&read, bitbuf__bench_widths[i & 3], NULL);
+        }
+        sink += sum;
+    }
+    bitbuf__bench_report("read mixed width fields, bitbuf_cursor_t", start, TOTAL);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_reader_t reader = bitbuf_reader_init(&buf);
+        uint64_t        sum = 0;
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            sum += bitbuf_reader_read_n_bits(&reader, bitbuf__bench_widths[i & 3]);
+        }
+        sink += sum;
+    }
+    bitbuf__bench_report("read mixed width fields, bitbuf_reader_t", start, TOTAL);
 
-    const float TEST_RANGES[][3] = {
-        /* min, max */
-        {+0.0f, +1.0f},
-        {-1.0, 0.0f},
-        {-1.0f, 1.0f},
-        {-32000.f, 32000.f},
-    };
-    const size_t TEST_RANGES_LEN = sizeof(TEST_RANGES) / sizeof(TEST_RANGES[0]);
+    (void)sink;
+    bitbuf_free_buffer(&buf);
+}
+
+static void
+bitbuf__bench_quantize(void)
+{
+    const size_t    TOTAL = (size_t)BITBUF__BENCH_FIELDS * BITBUF__BENCH_PASSES;
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(BITBUF__BENCH_FIELDS * 2 + 8);
+    float*          values = (float*)BITBUF_MALLOC(BITBUF__BENCH_FIELDS * sizeof(float));
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+        values[i] = (float)(i & 0xffff) / 0xffff;
+    }
 
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            bitbuf_write_quantized_float(&buf, 12, 0.0f, 1.0f, values[i]);
+        }
+    }
+    bitbuf__bench_report("write 12-bit floats, write_quantized_float", start, TOTAL);
 
-    for (i = 0; i < TEST_RANGES_LEN; i++) {
-        size_t n;
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_write_quantized_float_array(&buf, 12, 0.0f, 1.0f, values, BITBUF__BENCH_FIELDS);
+    }
+    bitbuf__bench_report("write 12-bit floats, write_quantized_float_array", start, TOTAL);
 
-        // todo: get this working with sizeof(float) * 3
-        bitbuf_buffer_t buf = bitbuf_alloc_buffer(256);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            values[i] = bitbuf_read_quantized_float(&read, 12, 0.0f, 1.0f);
+        }
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read 12-bit floats, read_quantized_float", start, TOTAL);
 
-        float in_min = TEST_RANGES[i][0];
-        float in_max = TEST_RANGES[i][1];
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_quantized_float_array(&read, 12, 0.0f, 1.0f, values, BITBUF__BENCH_FIELDS);
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read 12-bit floats, read_quantized_float_array", start, TOTAL);
 
-        for (n = 0; n < STORE_BITS_LEN; n++) {
-            int num_bits = STORE_BITS[n];
+    BITBUF_FREE(values);
+    bitbuf_free_buffer(&buf);
+}
 
-            bitbuf_write_quantized_float(&buf, num_bits, in_min, in_max, in_min);
-            bitbuf_write_quantized_float(&buf, num_bits, in_min, in_max, in_max);
+// each packet is one field
+static void
+bitbuf__bench_alloc(void)
+{
+    const size_t NUM_PACKETS = 1 << 20;
+    clock_t      start;
+    size_t       i;
+    int          j;
+
+    // 1200 byte packets carrying a 100 byte payload
+    start = clock();
+    for (i = 0; i < NUM_PACKETS; i++) {
+        bitbuf_buffer_t buf = bitbuf_alloc_buffer(1200);
+        for (j = 0; j < 25; j++) {
+            bitbuf_write_uint32(&buf, (uint32_t)i);
         }
-        TEST(!bitbuf_has_truncated(&buf));
+        bitbuf_free_buffer(&buf);
+    }
+    bitbuf__bench_report("alloc/write/free packets, alloc_buffer", start, NUM_PACKETS);
 
-        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+    start = clock();
+    for (i = 0; i < NUM_PACKETS; i++) {
+        bitbuf_buffer_t buf = bitbuf_alloc_pooled_buffer(1200);
+        for (j = 0; j < 25; j++) {
+            bitbuf_write_uint32(&buf, (uint32_t)i);
+        }
+        bitbuf_free_buffer(&buf);
+    }
+    bitbuf__bench_report("alloc/write/free packets, alloc_pooled_buffer", start, NUM_PACKETS);
 
-        for (n = 0; n < STORE_BITS_LEN; n++) {
-            int num_bits = STORE_BITS[n];
+    bitbuf_pool_trim();
+}
 
-            float min = bitbuf_read_quantized_float(&read, num_bits, in_min, in_max);
-            float max = bitbuf_read_quantized_float(&read, num_bits, in_min, in_max);
+static void
+bitbuf__bench_append(void)
+{
+    const size_t    TOTAL = (size_t)BITBUF__BENCH_FIELDS * BITBUF__BENCH_PASSES;
+    bitbuf_buffer_t part = bitbuf_alloc_buffer(BITBUF__BENCH_FIELDS * 2 + 8);
+    bitbuf_buffer_t merged = bitbuf_alloc_buffer(BITBUF__BENCH_FIELDS * 2 + 16);
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+        bitbuf_write_n_bits(&part, 11, i & 0x7ff);
+    }
 
-            TEST(min == in_min);
-            TEST(max == in_max);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&part);
+
+        bitbuf__bench_rewind(&merged);
+        bitbuf_write_n_bits(&merged, 3, 0);
+        for (i = 0; i < BITBUF__BENCH_FIELDS; i++) {
+            bitbuf_write_n_bits(&merged, 11, bitbuf_read_n_bits(&read, 11, NULL));
         }
+    }
+    bitbuf__bench_report("merge 11-bit fields, read then write", start, TOTAL);
 
-        bitbuf_free_buffer(&buf);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&merged);
+        bitbuf_write_n_bits(&merged, 3, 0);
+        bitbuf_append_buffer(&merged, &part);
     }
+    bitbuf__bench_report("merge 11-bit fields, bitbuf_append_buffer", start, TOTAL);
 
-    return ftgt_test_errorlevel();
+    bitbuf_free_buffer(&part);
+    bitbuf_free_buffer(&merged);
 }
 
-static int
-bitbuf__test_get_bytes_from_buffer(void)
+static void
+bitbuf__bench_rans(void)
 {
-    bitbuf_buffer_t* buf = &bitbuf__tv.buf;
+    const size_t    COUNT = (size_t)BITBUF__BENCH_FIELDS * 4;
+    const size_t    TOTAL = COUNT * BITBUF__BENCH_PASSES / 4;
+    uint8_t*        bytes = (uint8_t*)BITBUF_MALLOC(COUNT);
+    uint8_t*        out = (uint8_t*)BITBUF_MALLOC(COUNT);
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(COUNT + 4096);
+    uint64_t        rng = 0x9e3779b97f4a7c15ull;
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    // snapshot-like 6-bit values: mostly small deltas, some outliers
+    for (i = 0; i < COUNT; i++) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+        bytes[i] = (uint8_t)((rng >> 60) < 12 ? (rng >> 33) % 5 : (rng >> 33) % 64);
+    }
 
-    size_t num_bytes;
-    TEST(bitbuf_get_bytes_from_buffer(buf, &num_bytes) == (uint8_t*)buf->data);
-    TEST(num_bytes == 0);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES / 4; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_write_n_bits_array_uint8(&buf, 6, bytes, COUNT);
+    }
+    bitbuf__bench_report("write 6-bit bytes, bitbuf_write_n_bits_array", start, TOTAL);
+    printf("%-48s %7.2f bits/byte\n",
+           "  packed size",
+           (double)bitbuf_num_bits_written(&buf) / (double)COUNT);
 
-    bitbuf_write_bool(buf, true);
-    bitbuf_get_bytes_from_buffer(buf, &num_bytes);
-    TEST(num_bytes == 1);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES / 4; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_n_bits_array_uint8(&read, 6, out, COUNT);
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read 6-bit bytes, bitbuf_read_n_bits_array", start, TOTAL);
 
-    bitbuf_write_uint64(buf, 0xFF00FF00FF00FF00);
-    bitbuf_get_bytes_from_buffer(buf, &num_bytes);
-    TEST(num_bytes == 9);
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES / 4; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_write_rans_bytes(&buf, bytes, COUNT);
+    }
+    bitbuf__bench_report("write 6-bit bytes, bitbuf_write_rans_bytes", start, TOTAL);
+    printf("%-48s %7.2f bits/byte\n",
+           "  rans size",
+           (double)bitbuf_num_bits_written(&buf) / (double)COUNT);
 
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES / 4; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_rans_bytes(&read, out, COUNT);
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read 6-bit bytes, bitbuf_read_rans_bytes", start, TOTAL);
 
-    return ftgt_test_errorlevel();
+    BITBUF_FREE(bytes);
+    BITBUF_FREE(out);
+    bitbuf_free_buffer(&buf);
 }
 
-BITBUFDEF
-void
-bitbuf_decl_suite(void)
+static void
+bitbuf__bench_pfor(void)
 {
-    ftgt_suite_s* suite = ftgt_create_suite(
-        NULL, "bitbuf_core", bitbuf__test_setup, bitbuf__test_teardown);
-    FTGT_ADD_TEST(suite, bitbuf__test_basic);
-    FTGT_ADD_TEST(suite, bitbuf__test_buffer_overflow);
-    FTGT_ADD_TEST(suite, bitbuf__test_align_to_end_of_segment);
-    FTGT_ADD_TEST(suite, bitbuf__test_write_after_read);
-    FTGT_ADD_TEST(suite, bitbuf__test_crop_set_bit_on_n_write);
-    FTGT_ADD_TEST(suite, bitbuf__test_cstr_overflow);
-    FTGT_ADD_TEST(suite, bitbuf__test_read_buffers);
-    FTGT_ADD_TEST(suite, bitbuf__test_qfloat);
-    FTGT_ADD_TEST(suite, bitbuf__test_get_bytes_from_buffer);
+    const size_t    COUNT = (size_t)BITBUF__BENCH_FIELDS * 4;
+    const size_t    TOTAL = COUNT * BITBUF__BENCH_PASSES;
+    uint32_t*       values = (uint32_t*)BITBUF_MALLOC(COUNT * sizeof(uint32_t));
+    uint32_t*       out = (uint32_t*)BITBUF_MALLOC(COUNT * sizeof(uint32_t));
+    bitbuf_buffer_t buf = bitbuf_alloc_buffer(COUNT * sizeof(uint32_t) + 4096);
+    uint64_t        rng = 0x9e3779b97f4a7c15ull;
+    clock_t         start;
+    int             pass;
+    size_t          i;
+
+    // tick stamps: rising by 0..15, with rare outliers
+    for (i = 0; i < COUNT; i++) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+        values[i] = (uint32_t)(i * 8 + ((rng >> 60) ? 0 : (rng >> 40)));
+    }
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_write_n_bits_array_uint32(&buf, 32, values, COUNT);
+    }
+    bitbuf__bench_report("write uint32 ticks, bitbuf_write_n_bits_array", start, TOTAL);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_n_bits_array_uint32(&read, 32, out, COUNT);
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read uint32 ticks, bitbuf_read_n_bits_array", start, TOTAL);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf__bench_rewind(&buf);
+        bitbuf_write_pfor_u32(&buf, values, COUNT);
+    }
+    bitbuf__bench_report("write uint32 ticks, bitbuf_write_pfor_u32", start, TOTAL);
+    printf("%-48s %7.2f bits/value\n",
+           "  pfor size",
+           (double)bitbuf_num_bits_written(&buf) / (double)COUNT);
+
+    start = clock();
+    for (pass = 0; pass < BITBUF__BENCH_PASSES; pass++) {
+        bitbuf_cursor_t read = bitbuf_cursor_init(&buf);
+        bitbuf_read_pfor_u32(&read, out, COUNT);
+        buf.write.owner = NULL;
+    }
+    bitbuf__bench_report("read uint32 ticks, bitbuf_read_pfor_u32", start, TOTAL);
+
+    BITBUF_FREE(values);
+    BITBUF_FREE(out);
+    bitbuf_free_buffer(&buf);
 }
 
-#endif /* FTGT_TESTS_ENABLED */
+BITBUFDEF void
+bitbuf_run_benchmarks(void)
+{
+    bitbuf__bench_write();
+    bitbuf__bench_read();
+    bitbuf__bench_quantize();
+    bitbuf__bench_alloc();
+    bitbuf__bench_append();
+    bitbuf__bench_rans();
+    bitbuf__bench_pfor();
+}
+
+#endif /* BITBUF_BENCHMARKS_ENABLED */
 
 #endif /* defined(BITBUF_IMPLEMENT_BITBUFFER) */
 